@@ -1,4 +1,9 @@
 //Header behavior overrides
+#ifdef _WIN32
+#include <winsock2.h> //Needs the real windows.h, so it has to come before the _WINDOWS_ override
+#else
+#define _POSIX_C_SOURCE 200809L //For setenv() and shm_open(), which strict C99 hides
+#endif
 #define _WINDOWS_
 #define SDL_MAIN_HANDLED
 
@@ -8,10 +13,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
 #include <GL/gl.h>
 #include <GL/glext.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 //Only needed to keep a disconnected client from raising SIGPIPE on systems that have it
+#endif
 
 //OpenGL extension functions
 static PFNGLATTACHSHADERPROC             glAttachShader;
@@ -39,6 +64,7 @@ static PFNGLLINKPROGRAMPROC              glLinkProgram;
 static PFNGLSHADERSOURCEPROC             glShaderSource;
 static PFNGLUNIFORMMATRIX4FVPROC         glUniformMatrix4fv;
 static PFNGLUNIFORM1FPROC                glUniform1f;
+static PFNGLUNIFORM1FVPROC               glUniform1fv;
 static PFNGLUNIFORM2FVPROC               glUniform2fv;
 static PFNGLUNIFORM3FVPROC               glUniform3fv;
 static PFNGLUNIFORM4FVPROC               glUniform4fv;
@@ -52,6 +78,25 @@ static PFNGLFRAMEBUFFERTEXTURE2DPROC     glFramebufferTexture2D;
 static PFNGLDRAWBUFFERSPROC              glDrawBuffers;
 static PFNGLCHECKFRAMEBUFFERSTATUSPROC   glCheckFramebufferStatus;
 static PFNGLDELETEFRAMEBUFFERSPROC       glDeleteFramebuffers;
+static PFNGLBLITFRAMEBUFFERPROC          glBlitFramebuffer;
+static PFNGLDRAWARRAYSINSTANCEDPROC      glDrawArraysInstanced;
+static PFNGLTEXIMAGE3DPROC               glTexImage3D;
+static PFNGLTEXSUBIMAGE3DPROC            glTexSubImage3D;
+static PFNGLUNIFORM1IPROC                glUniform1i;
+static PFNGLMAPBUFFERRANGEPROC           glMapBufferRange;
+static PFNGLUNMAPBUFFERPROC              glUnmapBuffer;
+static PFNGLFENCESYNCPROC                glFenceSync;
+static PFNGLCLIENTWAITSYNCPROC           glClientWaitSync;
+static PFNGLDELETESYNCPROC               glDeleteSync;
+static PFNGLACTIVETEXTUREPROC            glActiveTexture;
+static PFNGLGENQUERIESPROC               glGenQueries;
+static PFNGLDELETEQUERIESPROC            glDeleteQueries;
+static PFNGLBEGINQUERYPROC               glBeginQuery;
+static PFNGLENDQUERYPROC                 glEndQuery;
+static PFNGLGETQUERYOBJECTIVPROC         glGetQueryObjectiv;
+static PFNGLGETQUERYOBJECTUI64VPROC      glGetQueryObjectui64v;
+
+static PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glMaxShaderCompilerThreadsKHR; //Optional; also loaded from the ARB version of the extension
 
 //Mathematical constants
 #define PI  3.1415927f
@@ -64,15 +109,134 @@ static PFNGLDELETEFRAMEBUFFERSPROC       glDeleteFramebuffers;
 #define SCROLL_PER_ROW 300.0f
 #define IMAGES_PER_ROW 4
 #define ROWS_IN_MEMORY 5
+#define TILE_SPACING 270.0f //Horizontal distance between the left edges of two adjacent images
+#define HOVER_BORDER 4 //Width in pixels of the highlight drawn around the image under the cursor
+#define IDLE_WAIT_MS 250 //Longest time to sleep waiting for events while nothing is animating
+#define FRAME_RATE 120 //Animation steps per second, and frames per second during a replay
+#define COMPILE_POLL_MS 1 //Longest time to sleep waiting for events while shaders are compiling, images are being read back, or tiles are waiting to be generated
+
+//Generation scheduler parameters
+#define RENDER_RESERVE 0.25 //Fraction of each frame left for drawing the screen; generating images gets the rest
+#define COST_QUERIES 8 //Timer queries of full-size draws in flight at once, for calibrating the cost model
+#define COST_SMOOTHING 0.2 //Weight of each new measurement in the cost model's running averages
 
 //Width and height of the sample taken for estimating normalization
 #define NORMALIZATION_SAMPLE_SIZE 4
 
-//Textures reserved for specific, non-display purposes
-#define RESERVED_TEXTURES 2
+//Interval bounds: results of ExpressionInterval
+#define INTERVAL_LOOSE 0 //Unbounded or undefined somewhere; the sample has to be used
+#define INTERVAL_TIGHT 1 //Sound, but an expression that uses several channels can overestimate its range
+#define INTERVAL_EXACT 2 //Only one channel, used once, so the bounds are the range over the input's channel range
+#define INTERVAL_MIN_COVERAGE 0.5f //Use TIGHT bounds only if the sample covers at least this fraction of them
+#define INTERVAL_SLACK 1e-3f //Bounds are widened by this fraction of their width, for the GPU's rounding and approximate transcendental functions
+
+//Screening: a larger sample, drawn next to the normalization sample, that's checked for degenerate output before the full-size draw
+#define SCREEN_SAMPLE_SIZE 16
+#define SCREEN_PATCH_SIZE 8 //Patches of the image at full resolution, drawn to the right of the screening sample, for measuring how rough it is...
+#define SCREEN_PATCHES 4 //...and how many, spread along the diagonal. The screening sample's pixels are too far apart for that, so any fine detail would look like noise.
+#define SAMPLE_WIDTH (NORMALIZATION_SAMPLE_SIZE + SCREEN_SAMPLE_SIZE + SCREEN_PATCHES * SCREEN_PATCH_SIZE) //Texels across the combined sample, which is SCREEN_SAMPLE_SIZE tall
+#define SAMPLE_ROW (SAMPLE_WIDTH * 3) //Floats per row of the combined sample readback
+#define SCREEN_MAX_NONFINITE 0.25f //Reject if more than this fraction of the samples are NaN or infinite
+#define SCREEN_FLAT_TOLERANCE 1e-4f //A channel whose range is this small relative to its magnitude is flat
+#define SCREEN_BINARY_MARGIN 0.02f //Samples this close to the minimum or maximum count as one of the two extremes...
+#define SCREEN_BINARY_FRACTION 0.98f //...and a channel with this fraction of its samples at the extremes is near-binary
+#define SCREEN_MAX_ROUGHNESS 0.25f //Mean difference between neighboring pixels in the patches, as a fraction of the channel's range, above which it's noise (about 1/3 for uniform white noise)
+#define SCREEN_MAX_RETRIES 8 //Give up screening a tile after this many rejections in a row, so a strange input image can't make it loop forever
+
+//Screening results
+#define SCREEN_ACCEPTED  0
+#define SCREEN_NONFINITE 1 //Mostly NaN or infinity
+#define SCREEN_FLAT      2 //Every channel is constant
+#define SCREEN_BINARY    3 //Every channel is constant or two-tone
+#define SCREEN_NOISE     4 //Every channel is constant, two-tone, or too noisy to be worth looking at
+#define SCREEN_REASONS   5
+
+//Most input images a layered draw can take at once; this is the size of the per-layer normalization uniform arrays
+#define MAX_LAYERS 64
+
+//Textures reserved for specific, non-display purposes: the input image, the normalization sample, and the window-sized composite that damaged regions are redrawn into
+#define RESERVED_TEXTURES 3
 //Maximum images that may be in memory at one time
 #define MAX_TEXTURES (IMAGES_PER_ROW * ROWS_IN_MEMORY) + RESERVED_TEXTURES
 
+//Maximum number of shader programs that may be compiling or waiting to be rendered at one time
+#define COMPILE_QUEUE_SIZE 16
+//Maximum number of worker threads (each with its own shared OpenGL context) used when the driver can't compile in parallel on its own
+#define MAX_COMPILE_THREADS 4
+
+//Exporting images
+#define EXPORT_QUEUE_SIZE 8 //Exports in progress at once, each with its own pixel buffer object
+#define EXPORT_THREADS 2 //Worker threads for encoding and writing files
+
+//Server mode parameters
+#define SERVER_DEFAULT_PORT 7470
+#define SERVER_MAX_CLIENTS 16
+#define SERVER_MAX_INPUTS 8 //Input images kept resident as textures between requests
+#define SERVER_BATCH_SIZE 32 //Maximum requests rendered together in one batch
+#define SERVER_COALESCE_MS 2 //How long to wait for more requests after the first one arrives, so concurrent requests end up in the same batch
+#define SERVER_REQUEST_MAX 4096 //Longest request line, including the newline; long enough for a list of MAX_LAYERS input images
+
+//Most bytes in one expression: 16 operators and 17 operands
+#define MAX_EXPRESSION_LENGTH 33
+#define MAX_CONSTANTS ((MAX_EXPRESSION_LENGTH - 1) / 2) //Every operand after the first could be a constant
+#define PROGRAM_CACHE_SIZE 64 //Linked programs kept around for reuse by expressions with the same skeleton
+#define PREFIX_CACHE_SIZE (IMAGES_PER_ROW * ROWS_IN_MEMORY) //Raw outputs kept as R32F textures; enough for every image in memory, so any of them can be liked
+#define PREFIX_MIN_LENGTH 5 //Shortest cached prefix worth a texture fetch (two operators)
+#define LIKE_CHILDREN 4 //Extensions of a liked expression queued along with the similar ones
+
+//Lookup table parameters
+#define LUT_SIZE 256 //Values of an 8-bit input channel
+#define LUT_MIN_LENGTH 5 //Shorter expressions are cheaper to evaluate than to look up
+
+//Inspector parameters
+#define INSPECTOR_TILE_SIZE 256 //Pixels across each cached tile of a zoomed image; tiles are drawn at up to twice this size on screen
+#define INSPECTOR_TILES 128 //Tiles kept as textures, for every zoom level together; enough to cover a 2560x1600 window at any one level
+#define INSPECTOR_MAX_LEVEL 16 //Deepest zoom level, where the image is 2^16 tiles across
+#define INSPECTOR_MAX_MAGNIFICATION 32.0 //Most screen pixels per input image pixel
+#define INSPECTOR_WHEEL_ZOOM 1.25 //Zoom factor per notch of the mouse wheel
+#define INSPECTOR_DRAG_ZOOM 1.01 //Zoom factor per pixel of dragging upward with the right button
+
+//Similarity index parameters
+#define EMBEDDING_CHANNELS 1 //Channels of the output that expressions actually produce; green and blue are constant for now (see fragmentShaderTemplate)
+#define EMBEDDING_SIZE (NORMALIZATION_SAMPLE_SIZE * NORMALIZATION_SAMPLE_SIZE * EMBEDDING_CHANNELS) //One byte per produced channel per pixel of the normalized sample
+#define SIMILAR_RESULTS 8 //Neighbors returned by a "more like this" query
+#define INDEX_FILE "filters.idx" //Every filter generated so far, appended as it's rendered
+#define INDEX_RECORD_SIZE (1 + MAX_EXPRESSION_LENGTH + EMBEDDING_SIZE) //Length byte, expression (padded), embedding
+#define INDEX_MAGIC "FIX1" //Start of INDEX_FILE's header, which is followed by the embedding size and the input image's size and hash, as native 32-bit integers
+#define INDEX_HEADER_SIZE 16
+#define CLICK_SLOP 4 //How far in pixels the cursor can move between mouse down and up and still count as a click
+
+//Session recording parameters
+#define SESSION_HEADER "FILTRANDMILL-SESSION 1" //First line of a session file, followed by the RNG seed
+
+//Expression enumeration parameters
+#define ENUM_OPERANDS 19 //3 channels followed by the 16 constants
+#define ENUM_MAX_OPERATORS 7 //Most operators that fit in a packed expression
+#define ENUM_SHARDS (3 * 8 * ENUM_OPERANDS) //Work is divided by first channel, first operator, and first operand
+#define ENUM_ARENA_SIZE 65536 //Packed expressions each thread buffers before writing them out
+#define ENUM_MAX_THREADS 64
+#define ENUM_CHECK_SAMPLES 32 //Input pixels each expression is evaluated at by --enumerate-check
+#define ENUM_CHECK_LEVELS 254 //Normalized outputs are compared after rounding to this many steps; 255 stands for infinity or NaN
+#define ENUM_CHECK_MARGIN 0.01 //Outputs this close (in steps) to rounding the other way are tried both ways, since equivalent expressions can round differently
+#define ENUM_CHECK_FLAT_TOLERANCE 1e-9 //An output whose range is this small relative to the values it came from is flat, in double precision
+#define ENUM_CHECK_FLOOR_TOLERANCE 1e-6 //A % whose quotient is this close to a whole number (relative to its size) could have gone either way
+#define ENUM_CHECK_UNSTABLE 2.0 //Steps single precision can be off from double before an expression counts as depending on rounding error
+#define ENUM_CHECK_MAX_BORDERLINE 10 //Most such outputs in one expression to try every combination of
+#define ENUM_CHECK_REPORT 20 //Missing classes printed before the rest are only counted
+
+//Generation farm parameters
+#define FARM_MAX_WORKERS 64
+#define FARM_SLOTS 4 //Slots in each worker's ring, so it can run ahead of the coordinator while files are being written
+#define FARM_POLL_MS 1 //How long the coordinator and workers sleep while waiting on each other
+#define FARM_INPUT "test.bmp" //Same as InitGL's, for sizing the slots before any worker has loaded it
+
+//States of a FarmSlot
+#define SLOT_FREE  0 //The worker can fill it
+#define SLOT_READY 1 //Filled; the coordinator owns it until it sets it free again
+
+//Packed expression layout: bits 0-1 hold the first channel, then each operator and its operand take 8 bits starting at bit 2 (low 5 bits: operand index, high 3 bits: operator), and bits 61-63 hold the number of operators
+#define PACKED_COUNT_SHIFT 61
+
 //Expression generation macros
 //TODO: EXP_RANDOM_CHANNEL should be (0x10 | randomi(9)) when all 9 channels I decided upon are included, maybe
 #define EXP_RANDOM_OPERATOR (rand() & 0x7)
@@ -80,29 +244,355 @@ static PFNGLDELETEFRAMEBUFFERSPROC       glDeleteFramebuffers;
 #define EXP_RANDOM_CONSTANT (0x20 | (rand() & 0xF))
 #define EXP_RANDOM_CHANNEL_OR_CONSTANT (rand() & 1 ? EXP_RANDOM_CHANNEL : EXP_RANDOM_CONSTANT)
 
-//The three shaders: the only vertex shader, one fragment shader that is only compiled once, and one that gets modified and compiled for each new image
+//For putting numeric constants into shader source
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+
+//The three shaders: the only vertex shader, one fragment shader that is only compiled once for displaying images, and one that gets modified and compiled for each new image
+//uvLevel and uvTile pick out one tile of the texture, split up the way the inspector splits images into zoom levels; they're both 0, for the whole texture, unless they're set.
 static const char soleVertexShader[] = "#version 330\n"
 "uniform mat4 projection;"
 "uniform vec2 translation;"
 "uniform float size;"
+"uniform float uvLevel;"
+"uniform vec2 uvTile;"
 "layout(location = 0) in vec2 position;"
 "layout(location = 1) in vec2 vertexUV;"
 "out vec2 UV;"
 "void main() {"
 "    gl_Position = projection * vec4(size * position + translation,0,1);"
-"    UV = vertexUV;"
+"    UV = (uvTile + vertexUV) / exp2(uvLevel);"
 "}"
 ;
+static const char displayFragmentShader[] = "#version 330\n uniform sampler2D t; in vec2 UV; layout(location = 0) out vec3 color; void main() {color = texture(t, UV).rgb;}";
 //fragmentShaderTemplate will hold the template and the to-be-compiled component. Elements 0 and 2 are template components, while element 1 can be modified.
-static char* fragmentShaderTemplate[3] = {"#version 330\n uniform sampler2D t; uniform vec3 normalizeMult; uniform vec3 normalizeAdd; in vec2 UV; layout(location = 0) out vec3 color; void main() {color = ", NULL, ";}"};
+//Generated expressions read the input channels from px, so the same expression works with either template.
+//Constants are read from the constants[] uniform rather than written into the source, so expressions that only differ in their constants can share a program.
+//The unnormalized result also goes to a second output, which RenderToTexture attaches a prefix cache texture to; an expression that starts with a cached one reads it back as prefixValue.
+//Green and blue are only set to 1 for now; I want to cycle the channels that appear in the expression and evaluate it 3 times, basically.
+static char* fragmentShaderTemplate[3] = {"#version 330\n uniform sampler2D t; uniform sampler2D prefix; uniform vec3 normalizeMult; uniform vec3 normalizeAdd; uniform float constants[" TOSTRING(MAX_CONSTANTS) "]; in vec2 UV; layout(location = 0) out vec3 color; layout(location = 1) out float raw;"
+    " \n#define prefixValue texture(prefix, UV).r\n void main() {vec3 px = texture(t, UV).rgb; raw = ", NULL, "; color = normalizeMult * vec3(raw, 1, 1) + normalizeAdd;}"};
+
+//Fragment shader for drawing an expression of one or two channels from a lookup table that it was baked into (see BakeLUT). lutX and lutY pick the channels that index each axis; lutY is 0 for one channel, so only the first row is used.
+static const char lutFragmentShader[] = "#version 330\n uniform sampler2D t; uniform sampler2D lut; uniform vec3 lutX; uniform vec3 lutY; uniform vec3 normalizeMult; uniform vec3 normalizeAdd; in vec2 UV; layout(location = 0) out vec3 color; layout(location = 1) out float raw;"
+    " void main() {vec3 px = texture(t, UV).rgb; raw = texture(lut, (vec2(dot(lutX, px), dot(lutY, px)) * 255.0 + 0.5) / " TOSTRING(LUT_SIZE) ".0).r; color = normalizeMult * vec3(raw, 1, 1) + normalizeAdd;}";
+
+//Layered versions of the shaders, for applying one expression to every layer of a texture array in a single instanced draw. Each instance is one layer, laid out in a grid that's columns wide, with its own normalization parameters.
+static const char layeredVertexShader[] = "#version 330\n"
+"uniform mat4 projection;"
+"uniform vec2 translation;"
+"uniform float size;"
+"uniform int columns;"
+"layout(location = 0) in vec2 position;"
+"layout(location = 1) in vec2 vertexUV;"
+"out vec2 UV;"
+"flat out int layer;"
+"void main() {"
+"    layer = gl_InstanceID;"
+"    gl_Position = projection * vec4(size * (position + vec2(gl_InstanceID % columns, gl_InstanceID / columns)) + translation,0,1);"
+"    UV = vertexUV;"
+"}"
+;
+static char* layeredFragmentShaderTemplate[3] = {"#version 330\n uniform sampler2DArray t; uniform vec3 layerMult[" TOSTRING(MAX_LAYERS) "]; uniform vec3 layerAdd[" TOSTRING(MAX_LAYERS) "]; uniform float constants[" TOSTRING(MAX_CONSTANTS) "]; in vec2 UV; flat in int layer; layout(location = 0) out vec3 color;"
+    " \n#define normalizeMult layerMult[layer]\n#define normalizeAdd layerAdd[layer]\n void main() {vec3 px = texture(t, vec3(UV, layer)).rgb; float raw = ", NULL, "; color = normalizeMult * vec3(raw, 1, 1) + normalizeAdd;}"};
 
 //Shader info log
 static char LOG[1024 * 8];
 
+//CRC-32 lookup table for writing PNG files, filled in by InitExportQueue
+static uint32_t crcTable[256];
+
 /*****************************************************************************
  *                                   Types                                   *
  *****************************************************************************/
 
+//States of a CompileJob
+#define JOB_FREE      0 //Slot is unused
+#define JOB_QUEUED    1 //Waiting for a worker thread to pick it up
+#define JOB_COMPILING 2 //Being compiled and linked, either by a worker thread or by the driver itself
+#define JOB_LINKED    3 //Program is linked and ready to render
+#define JOB_FAILED    4 //Compiling or linking failed
+#define JOB_RENDERING 5 //Linked, and being rendered by the main thread without holding the queue's lock
+
+//A fragment shader that has been submitted for compilation, along with where to render it once it's linked
+typedef struct {
+    int state; //One of the JOB_* values. Only touched while holding CompileQueue.lock.
+    int textureIdx; //Index into app->textures[] that the program will render to
+    char *source; //The dynamically allocated component that goes in fragmentShaderTemplate[1]
+    int layered; //Use layeredVertexShader and layeredFragmentShaderTemplate instead
+    GLuint shader;
+    GLuint program;
+} CompileJob;
+
+//States of a GeneratedImage, as far as the scheduler is concerned
+#define TILE_IDLE      0 //Drawn, or cancelled until it scrolls back into view
+#define TILE_PENDING   1 //Waiting for the scheduler to pick an expression (if it doesn't have one) and draw it or queue it to be compiled
+#define TILE_COMPILING 2 //Its program is in the compile queue
+
+//States of an ExportJob
+#define EXPORT_FREE     0 //Slot is unused
+#define EXPORT_READING  1 //Waiting for the readback into the pixel buffer object to finish
+#define EXPORT_ENCODING 2 //Pixels copied out, waiting for a worker thread
+#define EXPORT_WRITING  3 //A worker thread is encoding and writing it
+
+//An image being saved, along with what's needed to render it again
+typedef struct {
+    int state; //One of the EXPORT_* values. Only touched while holding ExportQueue.lock, except that the main thread owns jobs in EXPORT_READING.
+    GLuint pbo; //Pixel buffer object the texture is read back into
+    GLsync fence; //Signaled once the readback is done
+    unsigned char *pixels; //Copied out of pbo for the worker, dynamically allocated
+    int size;
+    unsigned char expression[MAX_EXPRESSION_LENGTH];
+    int expressionLength;
+    float normalizeMult[3];
+    float normalizeAdd[3];
+    char name[2 * MAX_EXPRESSION_LENGTH + 12]; //Files are written to <name>.png and <name>.txt
+} ExportJob;
+
+typedef struct {
+    ExportJob jobs[EXPORT_QUEUE_SIZE];
+    int pending; //Jobs that aren't EXPORT_FREE
+    int quit;
+    int threadCount;
+    SDL_Thread *threads[EXPORT_THREADS];
+    SDL_mutex *lock;
+    SDL_cond *wake;
+} ExportQueue;
+
+//A linked program that's kept for any expression with the same operators and channels, whatever its constants are
+typedef struct {
+    unsigned char skeleton[MAX_EXPRESSION_LENGTH]; //See ExpressionSkeleton
+    int length; //0 if this entry is unused
+    CompileJob job; //Only shader, program, and layered are used
+    unsigned long int lastUsed;
+} CachedProgram;
+
+typedef struct {
+    CachedProgram entries[PROGRAM_CACHE_SIZE];
+    unsigned long int clock; //Incremented on every lookup, for finding the least recently used entry
+    unsigned long int hits;
+    unsigned long int misses;
+} ProgramCache;
+
+//Raw (unnormalized) output of a recently drawn expression, so an expression that starts with it only has to evaluate the rest
+typedef struct {
+    unsigned char expression[MAX_EXPRESSION_LENGTH];
+    int length; //0 if this entry is unused
+    GLuint tex; //R32F, inputImageSize square; allocated the first time the entry is used
+    int users; //Images waiting to be drawn from this entry, which can't be replaced until they're done
+    unsigned long int lastUsed;
+} CachedPrefix;
+
+typedef struct {
+    CachedPrefix entries[PREFIX_CACHE_SIZE];
+    unsigned long int clock; //Incremented on every lookup and store, for finding the least recently used entry
+    unsigned long int hits;
+    unsigned long int misses;
+    unsigned long long int skippedOperators; //Operators that hits didn't have to evaluate per pixel
+} PrefixCache;
+
+//Shader programs in flight. With KHR_parallel_shader_compile, the driver compiles in the background and we poll GL_COMPLETION_STATUS_KHR. Without it, worker threads with shared contexts do the compiling and linking.
+typedef struct {
+    CompileJob jobs[COMPILE_QUEUE_SIZE];
+    int inFlight; //Number of jobs that aren't JOB_FREE
+    int parallelCompile; //Whether the driver supports KHR_parallel_shader_compile (or the ARB version)
+    int threadCount; //Number of worker threads; if this and parallelCompile are both 0, programs are compiled synchronously on submission
+    int nextThread; //Used by the worker threads to pick a context
+    int quit; //Tells the worker threads to stop
+    SDL_Thread *threads[MAX_COMPILE_THREADS];
+    SDL_GLContext contexts[MAX_COMPILE_THREADS];
+    SDL_mutex *lock;
+    SDL_cond *wake; //Signaled when a job is queued or finishes, or when the workers should quit
+} CompileQueue;
+
+typedef struct {
+    GLuint tex; //The textures[] array won't change, so it's fine to just copy a value from that array to this field. I could make this match the index of the texturse[] entry, but that's unnecessary processing time.
+    unsigned char *eR; //The bytes that represent operators and operands in the expression for the red channel
+    unsigned char *eG; //The bytes that represent operators and operands in the expression for the green channel
+    unsigned char *eB; //The bytes that represent operators and operands in the expression for the blue channel
+    int lengthR; //Number of bytes in eR (eG and eB aren't generated yet)
+    int ready; //Whether tex holds the rendered image yet, as opposed to still waiting for its shader to compile
+    int state; //One of the TILE_* values
+    int rejections; //Expressions for this tile thrown out by screening so far
+    int prefix; //Index into the prefix cache of the entry this is drawn from until it's drawn, or -1
+    int prefixLength; //Bytes at the start of eR that the program reads as prefixValue instead of evaluating (0 for none)
+    float normalizeMult[3]; //Normalization parameters it was drawn with, for exporting
+    float normalizeAdd[3];
+    unsigned char embedding[EMBEDDING_SIZE]; //Normalized sample of the output, for similarity search
+    //Do I need a hash set of all the expressions so you can hunt for matches? It'd probably be best to do something like that that can take a O(n) search time down to O(log n), but it's best to keep insertion time below O(n) too.
+    //TODO: Should I just make eG and EB match eR but with R->G->B->R / Chroma->Luminance->Chroma / Hue->Saturation->Value->Hue rotations?
+} GeneratedImage;
+
+//A piece of an image in the inspector. At zoom level L, an image is split into 2^L by 2^L tiles that are each rendered at INSPECTOR_TILE_SIZE, so level 0 is the whole image in one tile.
+typedef struct {
+    unsigned char expression[MAX_EXPRESSION_LENGTH];
+    int length; //0 if the entry is unused
+    int level;
+    int column; //From the left
+    int row; //From the bottom
+    GLuint tex; //RGB, INSPECTOR_TILE_SIZE square, created the first time the entry is used
+    unsigned long int lastUsed;
+} InspectorTile;
+
+//Zoomable view of one image, drawn instead of the grid while it's open. Only the tiles that are visible at the current zoom level are rendered (see InspectorRenderTiles), and the nearest coarser tiles that are cached stand in for them until they are.
+typedef struct {
+    int textureIdx; //Index into app->textures[] of the image being inspected, or -1 if the inspector is closed
+    unsigned char expression[MAX_EXPRESSION_LENGTH];
+    int length;
+    float normalizeMult[3]; //The image's normalization parameters, so the tiles match its thumbnail
+    float normalizeAdd[3];
+    CompileJob job; //Program for the whole expression, without a prefix; JOB_COMPILING until it has been checked
+    double x, y; //Bottom left corner of the whole image, in OpenGL window coordinates
+    double scale; //Width of the whole image on screen, in pixels
+    int missing; //Visible tiles that still have to be rendered, as of the last InspectorRenderTiles
+    InspectorTile tiles[INSPECTOR_TILES];
+    unsigned long int clock;
+    unsigned long int rendered;
+} Inspector;
+
+//A connection to the server
+typedef struct {
+    SOCKET socket; //INVALID_SOCKET if this slot is unused
+    char buffer[SERVER_REQUEST_MAX]; //Received bytes that don't make up a whole request line yet
+    int length;
+} ServerClient;
+
+//An input image, or a set of them, kept resident on the GPU by the server
+typedef struct {
+    char name[SERVER_REQUEST_MAX]; //File name(s) the client asked for, comma-separated ("" if this slot is unused)
+    GLuint tex; //Texture array with one layer per file
+    int layers;
+    int size; //Width in pixels; like the main program, the server assumes square inputs
+    float rangeMin[MAX_LAYERS][3]; //Range of each channel of each layer, for ExpressionInterval
+    float rangeMax[MAX_LAYERS][3];
+    unsigned long int lastUsed; //For evicting the least recently used input when all slots are full
+} ServerInput;
+
+//A parsed request, waiting to be batched with others for the same input
+typedef struct {
+    int client; //Index into Server.clients
+    int render; //TRUE to return the image (RENDER), FALSE to return only the normalization parameters (NORMALIZE)
+    int joint; //Normalize all the layers of a set of inputs together, instead of each one separately
+    ServerInput *input;
+    unsigned char expression[MAX_EXPRESSION_LENGTH];
+    int expressionLength;
+    CompileJob job;
+    int cached; //job.program belongs to the program cache, not this request
+    int intervalOnly; //A NORMALIZE request answered from interval bounds, without compiling or drawing anything
+    float normalizeMult[MAX_LAYERS][3]; //Per layer of the input
+    float normalizeAdd[MAX_LAYERS][3];
+    unsigned char *pixels; //Rendered images (RENDER only), one per layer in order, dynamically allocated
+} ServerRequest;
+
+//Server mode state
+typedef struct {
+    SOCKET listener;
+    ServerClient clients[SERVER_MAX_CLIENTS];
+    ServerInput inputs[SERVER_MAX_INPUTS];
+    ServerRequest requests[SERVER_BATCH_SIZE];
+    int requestCount;
+    unsigned long int batches; //Number of batches rendered so far; also serves as the clock for ServerInput.lastUsed
+    GLuint sampleTexture; //RGB32F, SERVER_BATCH_SIZE columns of normalization samples side by side, each with up to MAX_LAYERS samples stacked up
+    GLuint outputTexture; //RGB, resized to fit a grid of every layer of whichever input is being rendered
+    int outputWidth;
+    int outputHeight;
+    float pixelBuffer[SERVER_BATCH_SIZE * MAX_LAYERS * NORMALIZATION_SAMPLE_SIZE * NORMALIZATION_SAMPLE_SIZE * 3]; //Normalization sample readback
+} Server;
+
+//Appearance embeddings of generated filters for nearest-neighbor search, stored as parallel arrays so a query only streams through the embeddings
+typedef struct {
+    unsigned char *embeddings; //count * EMBEDDING_SIZE bytes, contiguous, scanned with SIMD
+    unsigned char *expressions; //count * MAX_EXPRESSION_LENGTH bytes
+    unsigned char *lengths; //count bytes
+    int count;
+    int capacity;
+    int *slots; //Open-addressed hash table of entries by expression (-1 for an empty slot), so each expression is only added once
+    int slotCount; //A power of 2, kept at least twice count
+    FILE *file; //INDEX_FILE, open for appending
+} FilterIndex;
+
+//Shared state for an enumeration run
+typedef struct {
+    int maxOperators;
+    const char *outputPrefix; //Each thread writes to <outputPrefix>.<thread number>
+    SDL_atomic_t nextShard; //Next shard for a thread to take
+} Enumeration;
+
+//Per-thread state for an enumeration run
+typedef struct {
+    Enumeration *enumeration;
+    int number;
+    FILE *file;
+    uint64_t *arena; //ENUM_ARENA_SIZE packed expressions waiting to be written
+    int used;
+    int failed; //Couldn't write the output
+    uint64_t visited; //Expressions considered, including ones that were only extended and not kept
+    uint64_t kept[ENUM_MAX_OPERATORS + 1]; //Expressions written out, by number of operators
+} EnumerationWorker;
+
+//Shared state for a generation farm run (see RunFarm)
+typedef struct {
+    unsigned char *memory; //Mapping shared by every process: each worker's ring of FARM_SLOTS slots in turn
+    size_t slotSize; //Bytes per slot, including its pixels
+    int size; //Width and height of the images
+    int workers;
+    unsigned int firstSeed;
+    unsigned int count; //Seeds in all, divided into consecutive ranges, one per worker
+} Farm;
+
+//Header of a slot in a farm worker's ring, followed by the image's pixels as glReadPixels writes them (RGB, bottom row first)
+typedef struct {
+    SDL_atomic_t state; //One of the SLOT_* values
+    unsigned int seed;
+    int rejections; //Expressions screening threw out before this one
+    unsigned char expression[MAX_EXPRESSION_LENGTH];
+    int expressionLength;
+    float normalizeMult[3];
+    float normalizeAdd[3];
+    unsigned char embedding[EMBEDDING_SIZE];
+} FarmSlot;
+
+//How many generated filters were thrown out before the full-size draw, and why, and how the rest were drawn
+typedef struct {
+    unsigned long int screened;
+    unsigned long int rejected[SCREEN_REASONS]; //By SCREEN_* reason; rejected[SCREEN_ACCEPTED] is unused
+    unsigned long long int skippedPixels; //Full-size pixels that didn't have to be drawn
+    unsigned long long int screenPixels; //Sample pixels drawn to screen them all
+    unsigned long int lutDraws; //Accepted filters drawn from a lookup table (see BakeLUT)
+} ScreenStats;
+
+//Predicts how long generating an image will take, so the scheduler can stay within the frame budget. Times are in performance counter ticks.
+typedef struct {
+    double ticksPerUnit; //GPU time per unit of ExpressionCostUnits, from timer queries of full-size draws
+    double renderTicks; //Main thread time in RenderToTexture, which is mostly waiting for the sample to be read back
+    GLuint queries[COST_QUERIES];
+    double queryUnits[COST_QUERIES]; //Units of the draw each query is timing, or 0 if it's free
+    unsigned long int cancelled; //Tiles dropped from the schedule because they scrolled off the top before being drawn
+    unsigned long int deferred; //Frames where generation stopped short to stay within the budget
+} CostModel;
+
+//The events of an interactive session, being recorded to a file or replayed from one (see ReplayLoop). Each line after the header is an event: milliseconds since the main loop started, a type letter, and three arguments.
+typedef struct {
+    FILE *file; //NULL if there's no session
+    int replaying; //Otherwise recording
+    unsigned int seed; //For srand()
+    uint64_t start; //Performance counter when the main loop started, while recording
+
+    //Next event to replay
+    int haveNext;
+    double nextTime;
+    char nextType;
+    int nextArgs[3];
+
+    //Replay measurements
+    double *frameTimes; //Milliseconds, one per frame, dynamically allocated
+    int frames;
+    int capacity;
+    int stalls; //Frames that went over budget while generating images
+    double stallTime; //Milliseconds they went over by, in total
+    size_t peakMemory; //Bytes; see TextureMemory
+} Session;
+
 //Main program state
 typedef struct {
 
@@ -113,7 +603,13 @@ typedef struct {
     //OpenGL fields
     GLuint program;   //Shader program
     GLuint svertex;   //Vertex shader
+    GLuint svertexLayered; //Vertex shader for layered draws
     GLuint sfragment; //Fragment shader
+    GLuint lutProgram; //Draws an image from a lookup table
+    GLuint lutFragment;
+    GLuint lutDomain; //RGB, LUT_SIZE square, with one channel counting up along each axis; see BakeLUT
+    int lutDomainLayout; //Which channels count along x and y in lutDomain, as 3 * x + y (-1 before it's filled in)
+    GLuint lutTexture; //R32F, LUT_SIZE square, that the expression being drawn was last baked into
 
 	GLuint attrib_position;
 	GLuint attrib_projection;
@@ -121,11 +617,38 @@ typedef struct {
 	GLuint attrib_vertexUV;
     GLuint attrib_texture;
 	GLuint attrib_size;
+    GLuint attrib_uvLevel;
+    GLuint attrib_uvTile;
 
     GLuint textures[MAX_TEXTURES];
+    GeneratedImage images[MAX_TEXTURES]; //Expression and state for each entry in textures[] (unused for the reserved ones)
+    CompileQueue compileQueue;
+    ProgramCache programCache;
+    PrefixCache prefixCache;
+    ExportQueue exportQueue;
+    FilterIndex filterIndex;
+    ScreenStats screenStats;
+    CostModel costModel;
+    int pendingTiles; //Tiles in TILE_PENDING as of the last ScheduleGeneration
+    int frameWork; //Images and inspector tiles rendered or started so far this frame. Only the first of them can run past the frame's deadline, whichever stage it's in.
+    Session session;
+    Inspector inspector;
+
+    //Expressions similar to the last one the user liked, and extensions of it, generated before any more random ones
+    unsigned char suggestions[SIMILAR_RESULTS + LIKE_CHILDREN][MAX_EXPRESSION_LENGTH];
+    int suggestionLengths[SIMILAR_RESULTS + LIKE_CHILDREN];
+    int suggestionCount;
     GLuint rttFramebuffer; //Render-to-texture framebuffer
+    GLuint compositeFramebuffer; //Framebuffer for textures[2]; it keeps the last frame so only damaged regions have to be redrawn
     int updated; //Determines whether we need to render
     int usedTextures;
+    int vsync; //Whether SDL_GL_SwapWindow waits for the vertical blank, which then paces the main loop
+    int headless; //Server mode: the window stays hidden and is only there for its OpenGL context
+    int farmWorker; //Rendering seeds for a generation farm in a child process; also headless
+
+    //Damage tracking, in OpenGL window coordinates (origin at the bottom left)
+    int damageFull; //The whole window needs to be redrawn
+    int damageX0, damageY0, damageX1, damageY1; //Bounding box of the regions that need to be redrawn otherwise
 
     //Application fields
     int width;  //Viewport width in pixels
@@ -133,8 +656,14 @@ typedef struct {
 	int oldCursorX; //Cursor coordinates
 	int oldCursorY;
 	int buttonDown; //Mouse button being pressed (0 = none)
+	int clickX; //Cursor coordinates when the button went down, to tell clicks from drags
+	int clickY;
+	int hoverTile; //Index into textures[] of the image under the cursor (-1 = none)
 
 	int inputImageSize;
+	uint32_t inputHash; //Of the input image's pixels, so the index can tell which image its embeddings came from
+	float inputMin[3]; //Range of each channel of the input image, for ExpressionInterval
+	float inputMax[3];
 
     //Scene fields
     GLuint VAB; //Vertex array buffer
@@ -145,15 +674,6 @@ typedef struct {
 	float scrollMinor; //Either percent or pixels scrolled between two rows; haven't decided yet
 	float scrollVelocity;
 } APP;
-
-typedef struct {
-    GLuint tex; //The textures[] array won't change, so it's fine to just copy a value from that array to this field. I could make this match the index of the texturse[] entry, but that's unnecessary processing time.
-    char *eR; //The bytes that represent operators and operands in the expression for the red channel
-    char *eG; //The bytes that represent operators and operands in the expression for the green channel
-    char *eB; //The bytes that represent operators and operands in the expression for the blue channel
-    //Do I need a hash set of all the expressions so you can hunt for matches? It'd probably be best to do something like that that can take a O(n) search time down to O(log n), but it's best to keep insertion time below O(n) too.
-    //TODO: Should I just make eG and EB match eR but with R->G->B->R / Chroma->Luminance->Chroma / Hue->Saturation->Value->Hue rotations?
-} GeneratedImage;
 
 
 
@@ -203,6 +723,362 @@ static float random() {
 static int randomi(int count) {
     return (int) floorf(random() * count);
 }
+
+//Find the range of each channel of a 24-bit BMP surface, scaled to [0,1] like the texture it's loaded into
+static void SurfaceRange(SDL_Surface *surface, float min[3], float max[3]) {
+    unsigned char low[3] = {255, 255, 255}, high[3] = {0, 0, 0};
+
+    for (int y = 0; y < surface->h; y++) {
+        const unsigned char *row = (const unsigned char*)surface->pixels + y * surface->pitch;
+        for (int x = 0; x < surface->w * 3; x += 3) {
+            for (int c = 0; c < 3; c++) {
+                unsigned char value = row[x + 2 - c]; //BGR
+                if (value < low[c]) low[c] = value;
+                if (value > high[c]) high[c] = value;
+            }
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        min[c] = low[c] / 255.0f;
+        max[c] = high[c] / 255.0f;
+    }
+}
+
+//FNV-1a hash of some bytes, continuing from hash (2166136261 to start)
+static uint32_t HashBytes(const unsigned char *data, size_t length, uint32_t hash) {
+    for (size_t x = 0; x < length; x++) hash = (hash ^ data[x]) * 16777619u;
+    return hash;
+}
+
+//Hash the pixels of a 24-bit BMP surface, leaving out each row's padding
+static uint32_t HashSurface(SDL_Surface *surface) {
+    uint32_t hash = 2166136261u;
+    for (int y = 0; y < surface->h; y++) hash = HashBytes((const unsigned char*)surface->pixels + y * surface->pitch, (size_t)surface->w * 3, hash);
+    return hash;
+}
+
+//Load a BMP file into a texture and find the range of each of its channels. Returns the width (which is also used as the height), or 0 on failure.
+static int LoadInputTexture(GLuint texture, const char *filename, float min[3], float max[3], uint32_t *hash) {
+    SDL_Surface *tex;
+    int size;
+
+    if (!(tex = SDL_LoadBMP(filename))) return 0;
+    SurfaceRange(tex, min, max);
+    *hash = HashSurface(tex);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex->w, tex->h, 0, GL_BGR, GL_UNSIGNED_BYTE, tex->pixels);
+    size = tex->w;
+    SDL_FreeSurface(tex);
+    return size;
+}
+
+//Copy an expression with every constant (and every operand that a unary operator ignores) replaced by the same placeholder, so expressions that would compile to the same program have the same skeleton
+//The first prefixLength bytes, which the program reads from the prefix cache instead, are all replaced by 0xFF.
+static void ExpressionSkeleton(const unsigned char *expression, int length, int prefixLength, unsigned char *skeleton) {
+    memcpy(skeleton, expression, length);
+    for (int x = 1; x + 1 < length; x += 2) {
+        if ((skeleton[x] & 0xF0) == 0x20 || skeleton[x + 1] == 5 || skeleton[x + 1] == 7) skeleton[x] = 0x20;
+    }
+    memset(skeleton, 0xFF, prefixLength);
+}
+
+//Find which input channels an expression reads, as a bit mask. Operands that a unary operator ignores don't count.
+static int ExpressionChannels(const unsigned char *expression, int length) {
+    int channels = 1 << (expression[0] & 0xF);
+    for (int x = 2; x < length; x += 2) {
+        if ((expression[x - 1] & 0xF0) == 0x10 && expression[x] != 5 && expression[x] != 7) channels |= 1 << (expression[x - 1] & 0xF);
+    }
+    return channels;
+}
+
+//Values of the constant operands 0x20 to 0x2F
+static const float expressionConstantLookup[16] = {0.1f, 0.3f, 0.7f, 0.9f, 1.5f, 2.5f, 6.0f, 10.0f, -0.1f, -0.3f, -0.7f, -0.9f, -1.5f, -2.5f, -6.0f, -10.0f};
+
+//Fill constants[] with the values of an expression's constants, in the slots expressionToGLSLString gives them
+static void ExpressionConstants(const unsigned char *expression, int length, float constants[MAX_CONSTANTS]) {
+    memset(constants, 0, MAX_CONSTANTS * sizeof *constants);
+    for (int x = 1; x < length; x += 2) {
+        if ((expression[x] & 0xF0) == 0x20) constants[x / 2] = expressionConstantLookup[expression[x] & 0xF];
+    }
+}
+
+//Load a comma-separated list of same-sized BMP files into the layers of a texture array, and find the range of each channel of each one. Returns the width (which is also used as the height), or 0 on failure.
+static int LoadInputArray(GLuint texture, const char *filenames, int *layers, float min[][3], float max[][3]) {
+    char filename[SERVER_REQUEST_MAX];
+    SDL_Surface *tex;
+    int width = 0, height = 0;
+
+    *layers = 1;
+    for (const char *c = filenames; *c; c++) *layers += *c == ',';
+    if (*layers > MAX_LAYERS) return 0;
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    for (int layer = 0; layer < *layers; layer++) {
+        int length = strcspn(filenames, ",");
+        if (length >= (int)sizeof filename) return 0;
+        memcpy(filename, filenames, length);
+        filename[length] = 0;
+        filenames += length + 1;
+
+        if (!(tex = SDL_LoadBMP(filename))) return 0;
+        if (!layer) {
+            width = tex->w;
+            height = tex->h;
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, width, height, *layers, 0, GL_BGR, GL_UNSIGNED_BYTE, 0);
+        } else if (tex->w != width || tex->h != height) {
+            SDL_FreeSurface(tex);
+            return 0;
+        }
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_BGR, GL_UNSIGNED_BYTE, tex->pixels);
+        SurfaceRange(tex, min[layer], max[layer]);
+        SDL_FreeSurface(tex);
+    }
+    return width;
+}
+
+//Find the min and max of each channel of a sample of raw filter output, NORMALIZATION_SAMPLE_SIZE pixels wide and rows tall. rowStride is the number of floats per row of samples.
+static void SampleRange(const float *pixelBuffer, int rowStride, int rows, float min[3], float max[3]) {
+    for (int y = 0; y < 3; y++) {
+        min[y] = __FLT_MAX__;
+        max[y] = -__FLT_MAX__;
+    }
+    for (int y = 0; y < rows; y++) {
+        for (int x = y * rowStride; x < y * rowStride + NORMALIZATION_SAMPLE_SIZE * 3; x += 3) {
+            if (pixelBuffer[x] < min[0]) min[0] = pixelBuffer[x];
+            if (pixelBuffer[x] > max[0]) max[0] = pixelBuffer[x];
+
+            if (pixelBuffer[x+1] < min[1]) min[1] = pixelBuffer[x+1];
+            if (pixelBuffer[x+1] > max[1]) max[1] = pixelBuffer[x+1];
+
+            if (pixelBuffer[x+2] < min[2]) min[2] = pixelBuffer[x+2];
+            if (pixelBuffer[x+2] > max[2]) max[2] = pixelBuffer[x+2];
+        }
+    }
+}
+
+//Convert the range of each channel into the multiplication and addition parameters that stretch it to [0,1]
+static void RangeToNormalization(const float min[3], const float max[3], float normalizeMult[3], float normalizeAdd[3]) {
+    for (int y = 0; y < 3; y++) {
+        if (min[y] == max[y]) {
+            //Set multiplication to 1.0 and addition to minimum value's negative, so this channel is all 0.
+            normalizeAdd[y] = -min[y];
+            normalizeMult[y] = 1.0f;
+        } else {
+            normalizeMult[y] = 1.0f / (max[y] - min[y]); //Divide by the range of the values, in other words.
+            normalizeAdd[y] = -min[y] * normalizeMult[y]; //And subtract the new minimum value (since multiplication comes before addition in the shader code I chose)
+        }
+    }
+}
+
+//Make an interval nonnegative, as abs() does to every value in it
+static inline void intervalAbs(float *lo, float *hi) {
+    if (*hi <= 0.0f) {
+        float swap = -*lo;
+        *lo = -*hi;
+        *hi = swap;
+    } else if (*lo < 0.0f) {
+        if (-*lo > *hi) *hi = -*lo;
+        *lo = 0.0f;
+    }
+}
+
+//Bound an expression's output using interval arithmetic, given the range of each input channel. Follows the GLSL that expressionToGLSLString writes, so pow and log take absolute values and mod is x - y * floor(x / y).
+//Returns INTERVAL_LOOSE (and leaves range alone) if the bounds are infinite or the result may be undefined, like for a division by an interval containing 0.
+static int ExpressionInterval(const unsigned char *expression, int length, const float inputMin[3], const float inputMax[3], float range[2]) {
+    int channels = 0; //Channel operands after the first
+    float lo = inputMin[expression[0] & 0xF], hi = inputMax[expression[0] & 0xF];
+
+    for (int x = 2; x < length; x += 2) {
+        unsigned char operand = expression[x - 1], op = expression[x];
+        float olo, ohi, corner[4];
+
+        if ((operand & 0xF0) == 0x20) olo = ohi = expressionConstantLookup[operand & 0xF];
+        else {
+            olo = inputMin[operand & 0xF];
+            ohi = inputMax[operand & 0xF];
+            if (op != 5 && op != 7) channels++; //The unary operators ignore it
+        }
+
+        switch (op) {
+            case 0: //a + b
+                lo += olo;
+                hi += ohi;
+                break;
+            case 1: //a - b
+                corner[0] = lo - ohi;
+                hi -= olo;
+                lo = corner[0];
+                break;
+            case 2: case 3: case 4: //a * b, a / b, and pow(abs(a), abs(b)), which are all monotonic in each argument, so their extremes are at the corners
+                if (op == 2) {
+                    corner[0] = lo * olo; corner[1] = lo * ohi; corner[2] = hi * olo; corner[3] = hi * ohi;
+                } else if (op == 3) {
+                    if (olo <= 0.0f && ohi >= 0.0f) return INTERVAL_LOOSE;
+                    corner[0] = lo / olo; corner[1] = lo / ohi; corner[2] = hi / olo; corner[3] = hi / ohi;
+                } else {
+                    intervalAbs(&lo, &hi);
+                    intervalAbs(&olo, &ohi);
+                    if (lo == 0.0f && olo == 0.0f) return INTERVAL_LOOSE; //pow(0, 0) is undefined
+                    corner[0] = powf(lo, olo); corner[1] = powf(lo, ohi); corner[2] = powf(hi, olo); corner[3] = powf(hi, ohi);
+                }
+                lo = hi = corner[0];
+                for (int y = 1; y < 4; y++) {
+                    if (corner[y] < lo) lo = corner[y];
+                    if (corner[y] > hi) hi = corner[y];
+                }
+                break;
+            case 5: //log(abs(a))
+                intervalAbs(&lo, &hi);
+                if (lo == 0.0f) return INTERVAL_LOOSE;
+                lo = logf(lo);
+                hi = logf(hi);
+                break;
+            case 6: //mod(a, b)
+                if (olo <= 0.0f && ohi >= 0.0f) return INTERVAL_LOOSE;
+                corner[1] = 4.0f * __FLT_EPSILON__ * (fabsf(lo) > fabsf(hi) ? fabsf(lo) : fabsf(hi)); //Rounding in a - b * floor(a / b) is about one ulp of a
+                if (olo == ohi && hi - lo < fabsf(olo) && floorf(lo / olo) == floorf(hi / olo)) {
+                    //All within one period, where it's just a - b * k
+                    corner[0] = olo * floorf(lo / olo);
+                    lo -= corner[0];
+                    hi -= corner[0];
+                } else if (olo > 0.0f) {
+                    lo = 0.0f;
+                    hi = ohi;
+                } else {
+                    lo = olo;
+                    hi = 0.0f;
+                }
+                lo -= corner[1];
+                hi += corner[1];
+                break;
+            case 7: //sin(a)
+                if (hi - lo >= PI2 || fabsf(lo) > 1e4f || fabsf(hi) > 1e4f) { //GPU sin() is only accurate for small arguments
+                    lo = -1.0f;
+                    hi = 1.0f;
+                    break;
+                }
+                corner[0] = sinf(lo);
+                corner[1] = sinf(hi);
+                corner[2] = PI / 2 + PI2 * ceilf((lo - PI / 2) / PI2); //First peak at or after lo
+                corner[3] = -PI / 2 + PI2 * ceilf((lo + PI / 2) / PI2); //First trough at or after lo
+                lo = corner[3] <= hi ? -1.0f : corner[0] < corner[1] ? corner[0] : corner[1];
+                hi = corner[2] <= hi ? 1.0f : corner[0] < corner[1] ? corner[1] : corner[0];
+                break;
+            default:
+                return INTERVAL_LOOSE;
+        }
+        if (!isfinite(lo) || !isfinite(hi)) return INTERVAL_LOOSE;
+    }
+
+    range[0] = lo - INTERVAL_SLACK * (hi - lo);
+    range[1] = hi + INTERVAL_SLACK * (hi - lo);
+    return channels ? INTERVAL_TIGHT : INTERVAL_EXACT;
+}
+
+//Work out an expression's normalization parameters from its interval bounds where they're good enough, and otherwise from a sample of its raw output (as for SampleRange)
+//Only the first channel comes from the expression for now; the others are constant (see expressionToGLSLString).
+static void ExpressionNormalization(const unsigned char *expression, int length, const float inputMin[3], const float inputMax[3],
+        const float *pixelBuffer, int rowStride, int rows, float normalizeMult[3], float normalizeAdd[3]) {
+    float min[3], max[3], range[2];
+
+    SampleRange(pixelBuffer, rowStride, rows, min, max);
+    switch (ExpressionInterval(expression, length, inputMin, inputMax, range)) {
+        case INTERVAL_TIGHT:
+            if (max[0] - min[0] < INTERVAL_MIN_COVERAGE * (range[1] - range[0])) break;
+            //Fall through
+        case INTERVAL_EXACT:
+            //The sample should be inside the bounds already, but don't clip it if the GPU's arithmetic disagrees
+            if (range[0] < min[0]) min[0] = range[0];
+            if (range[1] > max[0]) max[0] = range[1];
+            break;
+    }
+    RangeToNormalization(min, max, normalizeMult, normalizeAdd);
+}
+
+//Check a size x size sample of raw filter output for things that aren't worth drawing at full size, along with SCREEN_PATCHES patches of it at full resolution, side by side, for roughness. rowStride is the number of floats per row of both. Returns one of the SCREEN_* results.
+static int ScreenSample(const float *pixelBuffer, const float *patches, int rowStride, int size) {
+    int nonfinite = 0, flat = 0, binary = 0, noise = 0;
+
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size * 3; x++) {
+            if (!isfinite(pixelBuffer[y * rowStride + x])) nonfinite++;
+        }
+    }
+    if (nonfinite > SCREEN_MAX_NONFINITE * size * size * 3) return SCREEN_NONFINITE;
+
+    for (int c = 0; c < 3; c++) {
+        //Range of the finite values
+        float min = __FLT_MAX__, max = -__FLT_MAX__;
+        for (int y = 0; y < size; y++) {
+            for (int x = c; x < size * 3; x += 3) {
+                float value = pixelBuffer[y * rowStride + x];
+                if (!isfinite(value)) continue;
+                if (value < min) min = value;
+                if (value > max) max = value;
+            }
+        }
+        float magnitude = fabsf(min) > fabsf(max) ? fabsf(min) : fabsf(max);
+        if (min > max || max - min <= SCREEN_FLAT_TOLERANCE * (1.0f + magnitude)) {
+            flat++;
+            continue;
+        }
+
+        //Count samples at the extremes
+        float scale = 1.0f / (max - min), roughness = 0.0f;
+        int extremes = 0, count = 0, pairs = 0;
+        for (int y = 0; y < size; y++) {
+            for (int x = c; x < size * 3; x += 3) {
+                float value = pixelBuffer[y * rowStride + x];
+                if (!isfinite(value)) continue;
+                value = (value - min) * scale;
+                count++;
+                if (value < SCREEN_BINARY_MARGIN || value > 1.0f - SCREEN_BINARY_MARGIN) extremes++;
+            }
+        }
+
+        //Add up the differences between horizontal and vertical neighbors within each patch, which are adjacent pixels of the full-size image
+        for (int y = 0; y < SCREEN_PATCH_SIZE; y++) {
+            for (int x = c; x < SCREEN_PATCHES * SCREEN_PATCH_SIZE * 3; x += 3) {
+                const float *sample = &patches[y * rowStride + x];
+                if (!isfinite(*sample)) continue;
+                if ((x / 3 + 1) % SCREEN_PATCH_SIZE && isfinite(sample[3])) {
+                    roughness += fabsf(sample[3] - *sample) * scale;
+                    pairs++;
+                }
+                if (y + 1 < SCREEN_PATCH_SIZE && isfinite(sample[rowStride])) {
+                    roughness += fabsf(sample[rowStride] - *sample) * scale;
+                    pairs++;
+                }
+            }
+        }
+        if (extremes >= SCREEN_BINARY_FRACTION * count) binary++;
+        else if (pairs && roughness > SCREEN_MAX_ROUGHNESS * pairs) noise++;
+    }
+
+    //Only reject if no channel is worth looking at
+    if (flat == 3) return SCREEN_FLAT;
+    if (flat + binary == 3) return SCREEN_BINARY;
+    if (flat + binary + noise == 3) return SCREEN_NOISE;
+    return SCREEN_ACCEPTED;
+}
+
+//Print ScreenStats
+static void PrintScreenStats(FILE *file, const ScreenStats *stats) {
+    static const char *reasons[SCREEN_REASONS] = {NULL, "NaN/infinite", "flat", "near-binary", "noise"};
+    unsigned long int rejected = 0;
+
+    for (int x = 1; x < SCREEN_REASONS; x++) rejected += stats->rejected[x];
+    fprintf(file, "Screening: %lu of %lu filters rejected (", rejected, stats->screened);
+    for (int x = 1; x < SCREEN_REASONS; x++) fprintf(file, "%s%lu %s", x > 1 ? ", " : "", stats->rejected[x], reasons[x]);
+    fprintf(file, "); %llu full-size pixels skipped for %llu sample pixels drawn\r\n", stats->skippedPixels, stats->screenPixels);
+    if (stats->lutDraws) fprintf(file, "%lu filters drawn from lookup tables\r\n", stats->lutDraws);
+}
 
 //These two functions depend on app->height, which is variable, so they're inline functions and not macros.
 static inline int rowsPerScreen(APP *app) {
@@ -213,6 +1089,204 @@ static inline int imagesPerScreen(APP *app) {
     return rowsPerScreen(app) * IMAGES_PER_ROW;
 }
 
+//Bottom-left corner of the image stored in app->textures[textureIdx], in OpenGL window coordinates
+static inline void tilePosition(APP *app, int textureIdx, float vector[2]) {
+    vector[0] = TILE_SPACING * ((textureIdx - RESERVED_TEXTURES) % IMAGES_PER_ROW);
+    vector[1] = app->height + app->scrollMinor - SCROLL_PER_ROW * (1 + (textureIdx - RESERVED_TEXTURES) / IMAGES_PER_ROW) + (app->scrollMajor * SCROLL_PER_ROW); //TODO: The last part of this expression is for testing only until I start generating more rows.
+}
+
+//How many rows below the visible ones a tile is: 0 if it's on screen, or negative if it has scrolled off the top
+static inline long int tileDistance(APP *app, int textureIdx) {
+    long int row = (textureIdx - RESERVED_TEXTURES) / IMAGES_PER_ROW;
+    long int first = (long int)app->scrollMajor, last = first + rowsPerScreen(app);
+    return row < first ? row - first : row > last ? row - last : 0;
+}
+
+//Index into app->textures[] of the image under the given cursor position (SDL coordinates, origin at the top left), or -1 if there isn't one
+static int tileAt(APP *app, int x, int y) {
+    float vector[2];
+    y = app->height - y;
+    for (int idx = RESERVED_TEXTURES; idx < app->usedTextures; idx++) {
+        tilePosition(app, idx, vector);
+        if (x >= vector[0] && x < vector[0] + app->inputImageSize && y >= vector[1] && y < vector[1] + app->inputImageSize) return idx;
+    }
+    return -1;
+}
+
+//Whether Animate still has any work to do, i.e. the view is scrolling or bouncing back from an edge
+static inline int isScrolling(APP *app) {
+    return fabs(app->scrollVelocity) > SCROLL_STOP_THRESHOLD ||
+        (app->scrollMajor == 0 && app->scrollMinor < -SCROLL_STOP_THRESHOLD) ||
+        (app->scrollMajor == ULONG_MAX - (unsigned long int)rowsPerScreen(app) && app->scrollMinor > SCROLL_PER_ROW + SCROLL_STOP_THRESHOLD);
+}
+
+//Mark the whole window as needing to be redrawn
+static void DamageAll(APP *app) {
+    app->damageFull = TRUE;
+    app->updated = TRUE;
+}
+
+//Mark a rectangle (OpenGL window coordinates) as needing to be redrawn
+static void DamageRect(APP *app, int x, int y, int w, int h) {
+    //Clip to the window; there's nothing to redraw off-screen
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > app->width) w = app->width - x;
+    if (y + h > app->height) h = app->height - y;
+    if (w <= 0 || h <= 0) return;
+
+    if (!app->updated) {
+        app->damageX0 = x; app->damageY0 = y;
+        app->damageX1 = x + w; app->damageY1 = y + h;
+    } else {
+        if (x < app->damageX0) app->damageX0 = x;
+        if (y < app->damageY0) app->damageY0 = y;
+        if (x + w > app->damageX1) app->damageX1 = x + w;
+        if (y + h > app->damageY1) app->damageY1 = y + h;
+    }
+    app->updated = TRUE;
+}
+
+//Mark the image in app->textures[textureIdx] (including its hover highlight) as needing to be redrawn
+static void DamageTile(APP *app, int textureIdx) {
+    float vector[2];
+    if (textureIdx < RESERVED_TEXTURES) return;
+    tilePosition(app, textureIdx, vector);
+    DamageRect(app, (int)floorf(vector[0]) - HOVER_BORDER, (int)floorf(vector[1]) - HOVER_BORDER, app->inputImageSize + 2 * HOVER_BORDER + 1, app->inputImageSize + 2 * HOVER_BORDER + 1);
+}
+
+/*****************************************************************************
+ *                         Similarity Index Functions                        *
+ *****************************************************************************/
+
+//Print an expression as the hex bytecode that ParseExpression accepts
+static void PrintExpression(FILE *file, const unsigned char *expression, int length) {
+    for (int x = 0; x < length; x++) fprintf(file, "%02x", expression[x]);
+}
+
+//Sum of absolute differences between two embeddings
+static inline unsigned int EmbeddingDistance(const unsigned char *a, const unsigned char *b) {
+    unsigned int distance = 0;
+    int x = 0;
+#ifdef __SSE2__
+    //PSADBW does 16 bytes at a time, leaving one partial sum in each 64-bit half
+    __m128i sum = _mm_setzero_si128();
+    for (; x + 16 <= EMBEDDING_SIZE; x += 16) {
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + x)), _mm_loadu_si128((const __m128i*)(b + x))));
+    }
+    distance = _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum));
+#endif
+    for (; x < EMBEDDING_SIZE; x++) distance += abs(a[x] - b[x]);
+    return distance;
+}
+
+//Find an expression's slot in the index's hash table: the one holding its entry, or the empty one it would go in
+static int *IndexSlot(FilterIndex *index, const unsigned char *expression, int length) {
+    int slot = (int)(HashBytes(expression, length, 2166136261u) & (index->slotCount - 1));
+    for (;; slot = (slot + 1) & (index->slotCount - 1)) {
+        int entry = index->slots[slot];
+        if (entry < 0 || (index->lengths[entry] == length && !memcmp(index->expressions + (size_t)entry * MAX_EXPRESSION_LENGTH, expression, length))) return &index->slots[slot];
+    }
+}
+
+//Add a filter to the in-memory index, and to the file too if save is true, unless its expression is already there. Returns 0 on success.
+static int IndexAdd(FilterIndex *index, const unsigned char *embedding, const unsigned char *expression, int length, int save) {
+    unsigned char record[INDEX_RECORD_SIZE];
+
+    if (index->slotCount && *IndexSlot(index, expression, length) >= 0) return 0; //Rendered before, on this input, so it looks the same
+    if (2 * (index->count + 1) > index->slotCount) {
+        //Rehash everything into a table twice the size
+        int slotCount = index->slotCount ? index->slotCount * 2 : 2048;
+        int *slots = (int*)malloc(slotCount * sizeof (int));
+        if (!slots) return 1;
+        free(index->slots);
+        index->slots = slots;
+        index->slotCount = slotCount;
+        memset(slots, 0xFF, slotCount * sizeof (int));
+        for (int x = 0; x < index->count; x++) *IndexSlot(index, index->expressions + (size_t)x * MAX_EXPRESSION_LENGTH, index->lengths[x]) = x;
+    }
+    if (index->count == index->capacity) {
+        int capacity = index->capacity ? index->capacity * 2 : 1024;
+        unsigned char *embeddings = (unsigned char*)realloc(index->embeddings, (size_t)capacity * EMBEDDING_SIZE);
+        if (embeddings) index->embeddings = embeddings;
+        unsigned char *expressions = (unsigned char*)realloc(index->expressions, (size_t)capacity * MAX_EXPRESSION_LENGTH);
+        if (expressions) index->expressions = expressions;
+        unsigned char *lengths = (unsigned char*)realloc(index->lengths, capacity);
+        if (lengths) index->lengths = lengths;
+        if (!embeddings || !expressions || !lengths) return 1; //Whichever ones did grow are still fine to keep
+        index->capacity = capacity;
+    }
+
+    memcpy(index->embeddings + (size_t)index->count * EMBEDDING_SIZE, embedding, EMBEDDING_SIZE);
+    memset(index->expressions + (size_t)index->count * MAX_EXPRESSION_LENGTH, 0, MAX_EXPRESSION_LENGTH);
+    memcpy(index->expressions + (size_t)index->count * MAX_EXPRESSION_LENGTH, expression, length);
+    index->lengths[index->count] = (unsigned char)length;
+    *IndexSlot(index, expression, length) = index->count++;
+
+    if (save && index->file) {
+        record[0] = (unsigned char)length;
+        memcpy(record + 1, index->expressions + (size_t)(index->count - 1) * MAX_EXPRESSION_LENGTH, MAX_EXPRESSION_LENGTH);
+        memcpy(record + 1 + MAX_EXPRESSION_LENGTH, embedding, EMBEDDING_SIZE);
+        fwrite(record, 1, INDEX_RECORD_SIZE, index->file);
+    }
+    return 0;
+}
+
+//Find up to SIMILAR_RESULTS filters closest in appearance to the given embedding, skipping the one with the given expression. Fills results[] with index entries, nearest first, and returns how many it found.
+static int IndexSearch(FilterIndex *index, const unsigned char *embedding, const unsigned char *expression, int length, int results[SIMILAR_RESULTS]) {
+    unsigned int distances[SIMILAR_RESULTS];
+    int found = 0;
+
+    for (int x = 0; x < index->count; x++) {
+        unsigned int distance = EmbeddingDistance(embedding, index->embeddings + (size_t)x * EMBEDDING_SIZE);
+        if (found == SIMILAR_RESULTS && distance >= distances[found - 1]) continue; //The common case, so check it first
+
+        if (index->lengths[x] == length && !memcmp(index->expressions + (size_t)x * MAX_EXPRESSION_LENGTH, expression, length)) continue; //That's the query itself
+
+        //Insertion sort into the (tiny) result list
+        int y = found < SIMILAR_RESULTS ? found++ : found - 1;
+        for (; y > 0 && distances[y - 1] > distance; y--) {
+            distances[y] = distances[y - 1];
+            results[y] = results[y - 1];
+        }
+        distances[y] = distance;
+        results[y] = x;
+    }
+    return found;
+}
+
+//Load the index from INDEX_FILE and keep the file open to append new filters to it. Embeddings only compare on the same input image, so if the file was made from a different one (or by a version with different records), a new index is started instead.
+static void InitIndex(FilterIndex *index, int inputSize, uint32_t inputHash) {
+    uint32_t size = 0; //No size limit
+    uint8_t *data = LoadFile(INDEX_FILE, &size);
+    unsigned char header[INDEX_HEADER_SIZE];
+    uint32_t fields[3] = {EMBEDDING_SIZE, (uint32_t)inputSize, inputHash};
+
+    memcpy(header, INDEX_MAGIC, 4);
+    memcpy(header + 4, fields, sizeof fields);
+    int matches = data && size >= INDEX_HEADER_SIZE && !memcmp(data, header, INDEX_HEADER_SIZE) && (size - INDEX_HEADER_SIZE) % INDEX_RECORD_SIZE == 0;
+    if (data && !matches) fprintf(stderr, "%s is from a different input image; starting a new one.\r\n", INDEX_FILE);
+    if (matches) {
+        for (uint32_t x = INDEX_HEADER_SIZE; x + INDEX_RECORD_SIZE <= size; x += INDEX_RECORD_SIZE) {
+            if (data[x] > MAX_EXPRESSION_LENGTH || IndexAdd(index, data + x + 1 + MAX_EXPRESSION_LENGTH, data + x + 1, data[x], FALSE)) break;
+        }
+    }
+    free(data);
+
+    if (!(index->file = fopen(INDEX_FILE, matches ? "ab" : "wb"))) fprintf(stderr, "Could not open %s; filters won't be remembered.\r\n", INDEX_FILE);
+    else if (!matches) fwrite(header, 1, INDEX_HEADER_SIZE, index->file);
+}
+
+//Close the index file and free the in-memory index
+static void UninitIndex(FilterIndex *index) {
+    if (index->file) fclose(index->file);
+    free(index->embeddings);
+    free(index->expressions);
+    free(index->lengths);
+    free(index->slots);
+    memset(index, 0, sizeof *index);
+}
+
 /*****************************************************************************
  *                      Initializers and Uninitializers                      *
  *****************************************************************************/
@@ -224,66 +1298,210 @@ static void InitApp(APP *app) {
 	app->scrollMinor = 0.0f;
 	app->buttonDown = 0;
 	app->oldCursorX = 0; app->oldCursorY = 0;
+	app->hoverTile = -1;
+	app->inspector.textureIdx = -1;
+	app->suggestionCount = 0;
+	if (!app->session.file) InitIndex(&app->filterIndex, app->inputImageSize, app->inputHash); //Sessions start with an empty index that isn't saved, so "more like this" finds the same filters when they're replayed
+	DamageAll(app);
 }
 
 //Uninitialize application data
 static void UninitApp(APP *app) {
-
+    if (app->screenStats.screened) PrintScreenStats(stderr, &app->screenStats);
+    if (app->costModel.cancelled || app->costModel.deferred)
+        fprintf(stderr, "Scheduler: %lu tiles cancelled, %lu frames cut short; %.3f ns per unit, %.3f ms per image\r\n", app->costModel.cancelled, app->costModel.deferred,
+            app->costModel.ticksPerUnit * 1e9 / SDL_GetPerformanceFrequency(), app->costModel.renderTicks * 1e3 / SDL_GetPerformanceFrequency());
+    UninitIndex(&app->filterIndex);
+    for (int x = RESERVED_TEXTURES; x < MAX_TEXTURES; x++) {
+        free(app->images[x].eR);
+        app->images[x].eR = NULL;
+    }
 }
 
-//Render to app->textures[textureIdx] using the program currently in fragmentShaderTemplate. Expects you to put something in fragmentShaderTemplate[1] before calling it.
-static void RenderToTexture(APP *app, int textureIdx) {
-    GLint   status;
-    GLsizei length;
-	float vector[2];
-    float matrix[16];
-	float normalizeMult[3] = {1.0f, 1.0f, 1.0f};
-	float normalizeAdd[3] = {0.0f, 0.0f, 0.0f};
-
-	glBindFramebuffer(GL_FRAMEBUFFER, app->rttFramebuffer);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, app->textures[1], 0); //Use a reserved texture, which is of type RGB16F, for finding normalization parameters
+//Find the longest cached raw output that an expression starts with, and pin it until the expression has been drawn from it (see ReleasePrefix). Returns its index, or -1.
+static int PrefixCacheFind(PrefixCache *cache, const unsigned char *expression, int length) {
+    int best = -1;
 
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        fprintf(stderr, "Framebuffer setup failed; status = %d\r\n", glCheckFramebufferStatus(GL_FRAMEBUFFER));
-        goto catch;
+    cache->clock++;
+    for (int x = 0; x < PREFIX_CACHE_SIZE; x++) {
+        CachedPrefix *entry = &cache->entries[x];
+        if (entry->length >= PREFIX_MIN_LENGTH && entry->length < length && !memcmp(entry->expression, expression, entry->length)
+                && (best < 0 || entry->length > cache->entries[best].length)) best = x;
     }
+    if (best < 0) {
+        cache->misses++;
+        return -1;
+    }
+    cache->entries[best].lastUsed = cache->clock;
+    cache->entries[best].users++;
+    cache->hits++;
+    cache->skippedOperators += cache->entries[best].length / 2;
+    return best;
+}
 
-    //Set the viewport for the framebuffer
-    glViewport(0,0,256,256);
+//Unpin an image's prefix cache entry once the image has been drawn from it, or won't be
+static void ReleasePrefix(APP *app, GeneratedImage *image) {
+    if (image->prefix < 0) return;
+    app->prefixCache.entries[image->prefix].users--;
+    image->prefix = -1;
+}
 
-    //Prepare basic fragment shader
-    GLuint tempShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(tempShader, 3, (const GLchar **)&fragmentShaderTemplate[0], NULL);
-    glCompileShader(tempShader);
-    glGetShaderiv(tempShader, GL_COMPILE_STATUS, &status);
-    if (tempShader == 0 || status != GL_TRUE) {
-        fprintf(stderr, "Could not create fragment shader.\r\n");
-
-        //Output shader info log
-        glGetShaderInfoLog(tempShader, sizeof LOG, &length,
-            (GLchar *) &LOG[0]);
-        fprintf(stderr, "%s\r\n", LOG);
-        goto catch;
+//Pick the entry to keep an expression's raw output in, which is the least recently used one that isn't pinned, and take it over
+//Returns NULL if there's nothing to do: the expression is too short to be worth it, it's already cached, or every entry is pinned.
+static CachedPrefix *PrefixCacheStore(APP *app, const unsigned char *expression, int length) {
+    PrefixCache *cache = &app->prefixCache;
+    CachedPrefix *entry = NULL;
+
+    if (length < PREFIX_MIN_LENGTH) return NULL;
+    for (int x = 0; x < PREFIX_CACHE_SIZE; x++) {
+        CachedPrefix *other = &cache->entries[x];
+        if (other->length == length && !memcmp(other->expression, expression, length)) {
+            other->lastUsed = ++cache->clock;
+            return NULL;
+        }
+        if (!other->users && (!entry || other->lastUsed < entry->lastUsed)) entry = other;
     }
-
-    //Prepare shader program
-    GLuint tempProgram = glCreateProgram();
-    glAttachShader(tempProgram, app->svertex);
-    glAttachShader(tempProgram, tempShader);
-    glLinkProgram(tempProgram);
-    glGetProgramiv(tempProgram, GL_LINK_STATUS, &status);
-    if (tempProgram == 0 || status != GL_TRUE) {
-        fprintf(stderr, "Could not create shader program.\r\n");
-        goto catch;
-    }
-    glUseProgram(tempProgram);
+    if (!entry) return NULL;
 
-	GLuint attrib_position, attrib_projection, attrib_translation, attrib_vertexUV, attrib_texture, attrib_size, attrib_nm, attrib_na;
+    if (!entry->tex) {
+        glGenTextures(1, &entry->tex);
+        glBindTexture(GL_TEXTURE_2D, entry->tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, app->inputImageSize, app->inputImageSize, 0, GL_RED, GL_FLOAT, 0);
+    }
+    memcpy(entry->expression, expression, length);
+    entry->length = length;
+    entry->lastUsed = ++cache->clock;
+    return entry;
+}
 
-	//Get shader attrib locations
-	attrib_position = glGetAttribLocation(tempProgram, "position");
-	attrib_vertexUV = glGetAttribLocation(tempProgram, "vertexUV");
-	//Uniforms
+//Decide whether an expression should be drawn from a lookup table. It only pays off if it reads one or two channels, so that it's a function of 256 or 65536 input values, and there are fewer of those than pixels in the image.
+//Returns the channel mask (see ExpressionChannels), or 0 to evaluate it per pixel as usual.
+static int LUTChannels(APP *app, const unsigned char *expression, int length) {
+    int channels = ExpressionChannels(expression, length);
+    int values = channels & (channels - 1) ? LUT_SIZE * LUT_SIZE : LUT_SIZE;
+    if (length < LUT_MIN_LENGTH || channels == 7 || values >= app->inputImageSize * app->inputImageSize) return 0;
+    return channels;
+}
+
+//Estimate the GPU work of drawing an expression at full size, in arbitrary units: a rough relative cost for each operator, times the number of values it's evaluated for (see LUTChannels and PrefixCacheFind)
+static double ExpressionCostUnits(APP *app, const unsigned char *expression, int length, int prefixLength) {
+    static const double operatorCost[8] = {1.0, 1.0, 1.0, 2.0, 8.0, 4.0, 3.0, 4.0}; //+ - * / pow log mod sin
+    double pixels = (double)app->inputImageSize * app->inputImageSize;
+    double perValue = 1.0; //Reading the input and writing the output
+    int channels = LUTChannels(app, expression, length);
+
+    for (int x = length - 1; x > prefixLength; x -= 2) perValue += operatorCost[expression[x] & 0x7];
+    if (channels) return (channels & (channels - 1) ? LUT_SIZE * LUT_SIZE : LUT_SIZE) * perValue + pixels * 2.0;
+    if (prefixLength) perValue += 1.0;
+    return pixels * perValue;
+}
+
+//Predict the time drawing an image will take on the main thread, including the full-size draw it waits on when the next sample is read back. The prefix cache isn't looked up here, so this errs on the high side.
+static double PredictCost(APP *app, const GeneratedImage *image) {
+    return app->costModel.renderTicks + ExpressionCostUnits(app, image->eR, image->lengthR, 0) * app->costModel.ticksPerUnit;
+}
+
+//Fold the timer queries of any full-size draws that have finished into the cost model
+static void PollCostQueries(APP *app) {
+    CostModel *model = &app->costModel;
+    GLint available;
+    GLuint64 nanoseconds;
+
+    for (int x = 0; x < COST_QUERIES; x++) {
+        if (model->queryUnits[x] == 0.0) continue;
+        glGetQueryObjectiv(model->queries[x], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+        glGetQueryObjectui64v(model->queries[x], GL_QUERY_RESULT, &nanoseconds);
+        double ticks = nanoseconds * 1e-9 * SDL_GetPerformanceFrequency();
+        model->ticksPerUnit += COST_SMOOTHING * (ticks / model->queryUnits[x] - model->ticksPerUnit);
+        model->queryUnits[x] = 0.0;
+    }
+}
+
+//Evaluate the current program (linked from fragmentShaderTemplate, with its uniforms set) over every value of the channels it reads, into app->lutTexture, through the template's raw output
+//Leaves the framebuffer with nothing attached, and the viewport at the input image's size.
+static void BakeLUT(APP *app, int channels) {
+    static unsigned char domain[LUT_SIZE * LUT_SIZE * 3];
+    GLenum drawBuffers[2] = {GL_NONE, GL_COLOR_ATTACHMENT1};
+    int channelX, channelY, rows = LUT_SIZE;
+
+    //Channel x counts along the x axis and channel y along the y axis. With only one channel, any other one can go along y, since it's ignored.
+    for (channelX = 0; !(channels & (1 << channelX)); channelX++);
+    for (channelY = channelX + 1; channelY < 3 && !(channels & (1 << channelY)); channelY++);
+    if (channelY == 3) {
+        channelY = (channelX + 1) % 3;
+        rows = 1;
+    }
+    glBindTexture(GL_TEXTURE_2D, app->lutDomain);
+    if (app->lutDomainLayout != 3 * channelX + channelY) {
+        memset(domain, 0, sizeof domain);
+        for (int y = 0; y < LUT_SIZE; y++) {
+            for (int x = 0; x < LUT_SIZE; x++) {
+                domain[(y * LUT_SIZE + x) * 3 + channelX] = x;
+                domain[(y * LUT_SIZE + x) * 3 + channelY] = y;
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, LUT_SIZE, LUT_SIZE, GL_RGB, GL_UNSIGNED_BYTE, domain);
+        app->lutDomainLayout = 3 * channelX + channelY;
+    }
+
+    //The domain is drawn in place of the input image, and only the raw output is kept
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, app->lutTexture, 0);
+    glDrawBuffers(2, drawBuffers);
+    glViewport(0, 0, LUT_SIZE, rows);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 0, 0);
+    drawBuffers[0] = GL_COLOR_ATTACHMENT0;
+    glDrawBuffers(1, drawBuffers);
+    glViewport(0, 0, app->inputImageSize, app->inputImageSize);
+
+    //Point the lookup program at the axes
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+    glUseProgram(app->lutProgram);
+    axis[channelX] = 1.0f;
+    glUniform3fv(glGetUniformLocation(app->lutProgram, "lutX"), 1, axis);
+    axis[channelX] = 0.0f;
+    if (rows > 1) axis[channelY] = 1.0f;
+    glUniform3fv(glGetUniformLocation(app->lutProgram, "lutY"), 1, axis);
+}
+
+//Render to app->textures[textureIdx] using a program that has already been linked from fragmentShaderTemplate (see the compile queue functions)
+//Returns SCREEN_ACCEPTED, or the reason the output was rejected without drawing or allocating the full-size image.
+static int RenderToTexture(APP *app, GLuint tempProgram, int textureIdx) {
+	float vector[2];
+    float matrix[16];
+	float normalizeMult[3] = {1.0f, 1.0f, 1.0f};
+	float normalizeAdd[3] = {0.0f, 0.0f, 0.0f};
+    int result = SCREEN_ACCEPTED;
+    GeneratedImage *image = &app->images[textureIdx];
+    CostModel *model = &app->costModel;
+    uint64_t start = SDL_GetPerformanceCounter();
+    int query = -1;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, app->rttFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, app->textures[1], 0); //Use a reserved texture, which is of type RGB32F, for finding normalization parameters
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Framebuffer setup failed; status = %d\r\n", glCheckFramebufferStatus(GL_FRAMEBUFFER));
+        goto catch;
+    }
+
+    //Set the viewport for the framebuffer (the projection matrix maps the input image's size to it)
+    glViewport(0, 0, app->inputImageSize, app->inputImageSize);
+
+    glUseProgram(tempProgram);
+
+	GLuint attrib_position, attrib_projection, attrib_translation, attrib_vertexUV, attrib_texture, attrib_size, attrib_nm, attrib_na;
+
+	//Get shader attrib locations
+	attrib_position = glGetAttribLocation(tempProgram, "position");
+	attrib_vertexUV = glGetAttribLocation(tempProgram, "vertexUV");
+	//Uniforms
 	attrib_projection = glGetUniformLocation(tempProgram, "projection");
 	attrib_translation = glGetUniformLocation(tempProgram, "translation");
 	attrib_texture = glGetUniformLocation(tempProgram, "t");
@@ -294,6 +1512,17 @@ static void RenderToTexture(APP *app, int textureIdx) {
     //Set some uniforms
     glUniform3fv(attrib_nm, 1, normalizeMult);
     glUniform3fv(attrib_na, 1, normalizeAdd);
+    float constants[MAX_CONSTANTS];
+    ExpressionConstants(app->images[textureIdx].eR, app->images[textureIdx].lengthR, constants);
+    glUniform1fv(glGetUniformLocation(tempProgram, "constants"), MAX_CONSTANTS, constants);
+
+    //The cached raw output that the program reads prefixValue from, if any, goes in texture unit 1
+    if (image->prefix >= 0) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, app->prefixCache.entries[image->prefix].tex);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(tempProgram, "prefix"), 1);
+    }
 
     //Change the projection matrix
     memset(matrix, 0, sizeof matrix);
@@ -321,43 +1550,66 @@ static void RenderToTexture(APP *app, int textureIdx) {
     glBindVertexArray(app->VAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
+    //And a bit bigger right next to it, for screening
+    vector[0] = (float)NORMALIZATION_SAMPLE_SIZE;
+    glUniform2fv(attrib_translation, 1, vector);
+    glUniform1f(attrib_size, (float)SCREEN_SAMPLE_SIZE);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    //And the patches to the right of that, each one a SCREEN_PATCH_SIZE square of the image's pixels, picked out the way the inspector picks out its tiles
+    GLint attrib_uvLevel = glGetUniformLocation(tempProgram, "uvLevel"), attrib_uvTile = glGetUniformLocation(tempProgram, "uvTile");
+    int patchesAcross = app->inputImageSize / SCREEN_PATCH_SIZE;
+    glUniform1f(attrib_size, (float)SCREEN_PATCH_SIZE);
+    glUniform1f(attrib_uvLevel, log2f((float)app->inputImageSize / SCREEN_PATCH_SIZE));
+    for (int x = 0; x < SCREEN_PATCHES; x++) {
+        vector[0] = (float)(NORMALIZATION_SAMPLE_SIZE + SCREEN_SAMPLE_SIZE + x * SCREEN_PATCH_SIZE);
+        glUniform2fv(attrib_translation, 1, vector);
+        float tile[2];
+        tile[0] = tile[1] = (float)((2 * x + 1) * patchesAcross / (2 * SCREEN_PATCHES));
+        glUniform2fv(attrib_uvTile, 1, tile);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    //Back to the whole image for the full-size draw
+    vector[0] = vector[1] = 0.0f;
+    glUniform1f(attrib_uvLevel, 0.0f);
+    glUniform2fv(attrib_uvTile, 1, vector);
+
     //Now, using the results of our test run, figure out what normalizeMult and normalizeAdd should be, using glReadPixels.
     //Make a buffer to hold 3 channels of floats, taken from the initial rendered image in order to estimate the normalization parameters for the generated formula.
-    float pixelBuffer[NORMALIZATION_SAMPLE_SIZE * NORMALIZATION_SAMPLE_SIZE * 3];
+    float pixelBuffer[SAMPLE_ROW * SCREEN_SAMPLE_SIZE];
 
     glPixelStorei(GL_PACK_ALIGNMENT, 1); //Tell OpenGL not to align the output of glReadPixels to 4-byte boundaries.
     glReadBuffer(GL_COLOR_ATTACHMENT0);
-    glReadPixels(0, 0, NORMALIZATION_SAMPLE_SIZE, NORMALIZATION_SAMPLE_SIZE, GL_RGB, GL_FLOAT, &pixelBuffer[0]);
+    glReadPixels(0, 0, SAMPLE_WIDTH, SCREEN_SAMPLE_SIZE, GL_RGB, GL_FLOAT, &pixelBuffer[0]);
 
-    //Find the min and max for each channel
-    float min[3] = {__FLT_MAX__, __FLT_MAX__, __FLT_MAX__};
-    float max[3] = {-__FLT_MAX__, -__FLT_MAX__, -__FLT_MAX__};
-    for (int x = 0; x < NORMALIZATION_SAMPLE_SIZE * NORMALIZATION_SAMPLE_SIZE * 3; x += 3) {
-        if (pixelBuffer[x] < min[0]) min[0] = pixelBuffer[x];
-        if (pixelBuffer[x] > max[0]) max[0] = pixelBuffer[x];
-
-        if (pixelBuffer[x+1] < min[1]) min[1] = pixelBuffer[x+1];
-        if (pixelBuffer[x+1] > max[1]) max[1] = pixelBuffer[x+1];
-
-        if (pixelBuffer[x+2] < min[2]) min[2] = pixelBuffer[x+2];
-        if (pixelBuffer[x+2] > max[2]) max[2] = pixelBuffer[x+2];
+    //Throw out degenerate filters before doing anything else with them, unless this tile has already had too many thrown out
+    app->screenStats.screened++;
+    app->screenStats.screenPixels += NORMALIZATION_SAMPLE_SIZE * NORMALIZATION_SAMPLE_SIZE + SCREEN_SAMPLE_SIZE * SCREEN_SAMPLE_SIZE + SCREEN_PATCHES * SCREEN_PATCH_SIZE * SCREEN_PATCH_SIZE;
+    result = ScreenSample(&pixelBuffer[NORMALIZATION_SAMPLE_SIZE * 3], &pixelBuffer[(NORMALIZATION_SAMPLE_SIZE + SCREEN_SAMPLE_SIZE) * 3], SAMPLE_ROW, SCREEN_SAMPLE_SIZE);
+    if (result != SCREEN_ACCEPTED && image->rejections < SCREEN_MAX_RETRIES) {
+        app->screenStats.rejected[result]++;
+        app->screenStats.skippedPixels += (unsigned long long int)app->inputImageSize * app->inputImageSize;
+        image->rejections++;
+        goto catch;
     }
+    result = SCREEN_ACCEPTED;
 
-    //Now convert min and max to multiplication and addition parameters.
-    for (int y = 0; y < 3; y++) {
-        if (min[y] == max[y]) {
-            //Set multiplication to 1.0 and addition to minimum value's negative, so this channel is all 0.
-            normalizeAdd[y] = -min[y];
-            normalizeMult[y] = 1.0f;
-        } else {
-            normalizeMult[y] = 1.0f / (max[y] - min[y]); //Divide by the range of the values, in other words.
-            normalizeAdd[y] = -min[y] * normalizeMult[y]; //And subtract the new minimum value (since multiplication comes before addition in the shader code I chose)
-        }
-    }
+    //Find the min and max for each channel and convert them to multiplication and addition parameters
+    ExpressionNormalization(image->eR, image->lengthR, app->inputMin, app->inputMax, pixelBuffer, SAMPLE_ROW, NORMALIZATION_SAMPLE_SIZE, normalizeMult, normalizeAdd);
+    memcpy(image->normalizeMult, normalizeMult, sizeof image->normalizeMult);
+    memcpy(image->normalizeAdd, normalizeAdd, sizeof image->normalizeAdd);
     glUniform3fv(attrib_nm, 1, normalizeMult);
     glUniform3fv(attrib_na, 1, normalizeAdd);
 
-    //TODO: We can now apply the normalization to the contents of pixelBuffer[] and use that as a key to check for expression equivalence.
+    //Apply the normalization to the contents of pixelBuffer[] to get an appearance embedding for similarity search
+    //TODO: It could also be used as a key to check for expression equivalence.
+    //Only the channels expressions produce go in it, since the constant ones would normalize to 0 for every filter
+    for (int x = 0; x < EMBEDDING_SIZE; x++) {
+        int pixel = x / EMBEDDING_CHANNELS, channel = x % EMBEDDING_CHANNELS;
+        float value = pixelBuffer[pixel / NORMALIZATION_SAMPLE_SIZE * SAMPLE_ROW + pixel % NORMALIZATION_SAMPLE_SIZE * 3 + channel] * normalizeMult[channel] + normalizeAdd[channel];
+        image->embedding[x] = (unsigned char)(value <= 0.0f ? 0 : value >= 1.0f ? 255 : value * 255.0f + 0.5f);
+    }
+    IndexAdd(&app->filterIndex, image->embedding, image->eR, image->lengthR, TRUE);
 
     //Finally, process the whole image and apply the normalization parameters simultaneously, putting the results in a standard GL_RGB texture.
     //Set up an image-specific texture for render-to-texture stuff
@@ -366,26 +1618,72 @@ static void RenderToTexture(APP *app, int textureIdx) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, app->inputImageSize, app->inputImageSize, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
 
+    //Time the full-size draw on the GPU, for the cost model
+    for (int x = 0; x < COST_QUERIES && query < 0; x++) {
+        if (model->queryUnits[x] == 0.0) query = x;
+    }
+    if (query >= 0) {
+        model->queryUnits[query] = ExpressionCostUnits(app, image->eR, image->lengthR, image->prefixLength);
+        glBeginQuery(GL_TIME_ELAPSED, model->queries[query]);
+    }
+
+    //Expressions of one or two channels are evaluated once per input value instead of once per pixel, and the image is drawn from that table
+    int lutChannels = LUTChannels(app, image->eR, image->lengthR);
+    if (lutChannels) {
+        glUniform1f(attrib_size, (float)app->inputImageSize); //Fill the whole viewport, whatever its size
+        vector[0] = 0.0f;
+        glUniform2fv(attrib_translation, 1, vector);
+        BakeLUT(app, lutChannels);
+
+        attrib_projection = glGetUniformLocation(app->lutProgram, "projection");
+        attrib_translation = glGetUniformLocation(app->lutProgram, "translation");
+        attrib_texture = glGetUniformLocation(app->lutProgram, "t");
+        attrib_size = glGetUniformLocation(app->lutProgram, "size");
+        glUniformMatrix4fv(attrib_projection, 1, GL_FALSE, matrix);
+        glUniform3fv(glGetUniformLocation(app->lutProgram, "normalizeMult"), 1, normalizeMult);
+        glUniform3fv(glGetUniformLocation(app->lutProgram, "normalizeAdd"), 1, normalizeAdd);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, app->lutTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(app->lutProgram, "lut"), 1);
+        app->screenStats.lutDraws++;
+    }
+
 	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, app->textures[textureIdx], 0); //Use the image-specific output texture for output this time
 	glUniform1f(attrib_size, (float)app->inputImageSize); //Set the proper image size
+    vector[0] = 0.0f;
+    glUniform2fv(attrib_translation, 1, vector);
+
+    //Keep the raw output as well, from the template's second output, so expressions that start with this one can be drawn from it
+    GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    CachedPrefix *store = PrefixCacheStore(app, image->eR, image->lengthR);
+    if (store) {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, store->tex, 0);
+        glDrawBuffers(2, drawBuffers);
+    }
+
     //Do roughly the same output, but this time, it'll apply our normalization parameters.
     glBindTexture(GL_TEXTURE_2D, app->textures[0]);
     glUniform1f(attrib_texture, app->textures[0]);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
+    if (store) {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 0, 0);
+        glDrawBuffers(1, drawBuffers);
+    }
+    if (query >= 0) glEndQuery(GL_TIME_ELAPSED);
+
 
 catch:
+    ReleasePrefix(app, image);
+    model->renderTicks += COST_SMOOTHING * ((double)(SDL_GetPerformanceCounter() - start) - model->renderTicks);
+
     //Return to using the normal shader
     glUseProgram(app->program);
 
-    //Cleanup
-    glDetachShader(tempProgram, app->svertex);
-    glDetachShader(tempProgram, tempShader);
-    glDeleteShader(tempShader);
-    glDeleteProgram(tempProgram);
-
     glBindFramebuffer(GL_FRAMEBUFFER, 0); //Draw to screen again after this, not to a framebuffer
     glViewport(0, 0, app->width, app->height);
+    return result;
 }
 
 static void GenerateRect(APP *app) {
@@ -420,7 +1718,7 @@ static int InitGL(APP *app) {
 
     //Refer to shader sources
     const GLchar *svertex   = (const GLchar *) &soleVertexShader[0];
-    const GLchar **sfragment = (const GLchar **) &fragmentShaderTemplate[0];
+    const GLchar *sfragment = (const GLchar *) &displayFragmentShader[0];
 
     //Resolve extension function addresses
     #define GLEXT(x) ((*(void **)&x=(void*)SDL_GL_GetProcAddress(#x))==NULL)
@@ -450,6 +1748,7 @@ static int InitGL(APP *app) {
         GLEXT(glShaderSource            ) ||
         GLEXT(glUniformMatrix4fv        ) ||
         GLEXT(glUniform1f               ) ||
+        GLEXT(glUniform1fv              ) ||
         GLEXT(glUniform2fv              ) ||
         GLEXT(glUniform3fv              ) ||
         GLEXT(glUniform4fv              ) ||
@@ -461,6 +1760,23 @@ static int InitGL(APP *app) {
         GLEXT(glDrawBuffers             ) ||
         GLEXT(glCheckFramebufferStatus  ) ||
         GLEXT(glDeleteFramebuffers      ) ||
+        GLEXT(glBlitFramebuffer         ) ||
+        GLEXT(glDrawArraysInstanced     ) ||
+        GLEXT(glTexImage3D              ) ||
+        GLEXT(glTexSubImage3D           ) ||
+        GLEXT(glUniform1i               ) ||
+        GLEXT(glMapBufferRange          ) ||
+        GLEXT(glUnmapBuffer             ) ||
+        GLEXT(glFenceSync               ) ||
+        GLEXT(glClientWaitSync          ) ||
+        GLEXT(glDeleteSync              ) ||
+        GLEXT(glActiveTexture           ) ||
+        GLEXT(glGenQueries              ) ||
+        GLEXT(glDeleteQueries           ) ||
+        GLEXT(glBeginQuery              ) ||
+        GLEXT(glEndQuery                ) ||
+        GLEXT(glGetQueryObjectiv        ) ||
+        GLEXT(glGetQueryObjectui64v     ) ||
         GLEXT(glVertexAttribPointer     )
     ) {
         fprintf(stderr, "Error initializing OpenGL extensions.\r\n");
@@ -490,11 +1806,26 @@ static int InitGL(APP *app) {
         goto catch;
     }
 
+    //Prepare the vertex shader for layered draws
+    const GLchar *svertexLayered = (const GLchar *) &layeredVertexShader[0];
+    app->svertexLayered = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(app->svertexLayered, 1, &svertexLayered, NULL);
+    glCompileShader(app->svertexLayered);
+    glGetShaderiv(app->svertexLayered, GL_COMPILE_STATUS, &status);
+    if (app->svertexLayered == 0 || status != GL_TRUE) {
+        fprintf(stderr, "Could not create layered vertex shader.\r\n");
+
+        //Output shader info log
+        glGetShaderInfoLog(app->svertexLayered, sizeof LOG, &length,
+            (GLchar *) &LOG[0]);
+        fprintf(stderr, "%s\r\n", LOG);
+
+        goto catch;
+    }
+
     //Prepare basic fragment shader
-    fragmentShaderTemplate[1] = "texture(t, UV).rgb";
-    //fragmentShaderTemplate[1] = "vec3(1,1,1)";
     app->sfragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(app->sfragment, 3, sfragment, NULL);
+    glShaderSource(app->sfragment, 1, &sfragment, NULL);
     glCompileShader(app->sfragment);
     glGetShaderiv(app->sfragment, GL_COMPILE_STATUS, &status);
     if (app->sfragment == 0 || status != GL_TRUE) {
@@ -528,23 +1859,42 @@ static int InitGL(APP *app) {
 	app->attrib_translation = glGetUniformLocation(app->program, "translation");
 	app->attrib_texture = glGetUniformLocation(app->program, "t");
     app->attrib_size = glGetUniformLocation(app->program, "size");
+    app->attrib_uvLevel = glGetUniformLocation(app->program, "uvLevel");
+    app->attrib_uvTile = glGetUniformLocation(app->program, "uvTile");
+
+    //Prepare the lookup table program
+    const GLchar *slut = (const GLchar *) &lutFragmentShader[0];
+    app->lutFragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(app->lutFragment, 1, &slut, NULL);
+    glCompileShader(app->lutFragment);
+    glGetShaderiv(app->lutFragment, GL_COMPILE_STATUS, &status);
+    if (app->lutFragment == 0 || status != GL_TRUE) {
+        fprintf(stderr, "Could not create lookup table fragment shader.\r\n");
+
+        //Output shader info log
+        glGetShaderInfoLog(app->lutFragment, sizeof LOG, &length,
+            (GLchar *) &LOG[0]);
+        fprintf(stderr, "%s\r\n", LOG);
+
+        goto catch;
+    }
+    app->lutProgram = glCreateProgram();
+    glAttachShader(app->lutProgram, app->svertex);
+    glAttachShader(app->lutProgram, app->lutFragment);
+    glLinkProgram(app->lutProgram);
+    glGetProgramiv(app->lutProgram, GL_LINK_STATUS, &status);
+    if (app->lutProgram == 0 || status != GL_TRUE) {
+        fprintf(stderr, "Could not create lookup table shader program.\r\n");
+        goto catch;
+    }
 
 	//Generate texture
 	glGenTextures(MAX_TEXTURES, app->textures);
 
 	//Load texture
-	SDL_Surface *tex;
-	if ((tex = SDL_LoadBMP("test.bmp"))) {
-        glBindTexture(GL_TEXTURE_2D, app->textures[0]);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex->w, tex->h, 0, GL_BGR, GL_UNSIGNED_BYTE, tex->pixels);
-        glUniform1f(app->attrib_size, (float)tex->w); //Draw the image at full size rather than 1x1 due to reusing the same struct for the vertices and UV coordinates
-        app->inputImageSize = tex->w;
-        SDL_FreeSurface(tex);
-	} else {
+	if ((app->inputImageSize = LoadInputTexture(app->textures[0], "test.bmp", app->inputMin, app->inputMax, &app->inputHash))) {
+        glUniform1f(app->attrib_size, (float)app->inputImageSize); //Draw the image at full size rather than 1x1 due to reusing the same struct for the vertices and UV coordinates
+	} else if (!app->headless) { //The server loads its inputs on request
 	    fprintf(stderr, "Could not load texture.\r\n");
         goto catch;
 	}
@@ -556,12 +1906,35 @@ static int InitGL(APP *app) {
     GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
     glDrawBuffers(1, DrawBuffers);
 
+    //The composite texture is (re)allocated by onResize, since it has to match the window size
+	glGenFramebuffers(1, &app->compositeFramebuffer);
+
     //Set up a small texture that we can use for estimating the normalization parameters for a generated image
 	glBindTexture(GL_TEXTURE_2D, app->textures[1]);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    //Key point: RGB16F and GL_FLOAT. It's a texture of floats because we'll use it for finding the normalization parameters, and the values won't be clamped to [0,1].
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, NORMALIZATION_SAMPLE_SIZE, NORMALIZATION_SAMPLE_SIZE, 0, GL_RGB, GL_FLOAT, 0);
+    //Key point: RGB32F and GL_FLOAT. It's a texture of floats because we'll use it for finding the normalization parameters, and the values won't be clamped to [0,1].
+    //Full floats rather than half floats, since anything past 65504 would turn into infinity and get the image rejected as non-finite; it's small enough that the size doesn't matter.
+    //The screening sample goes to the right of the normalization sample, and the screening patches to the right of that.
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, SAMPLE_WIDTH, SCREEN_SAMPLE_SIZE, 0, GL_RGB, GL_FLOAT, 0);
+
+    //And the lookup table, along with the input values it's baked from
+    glGenTextures(1, &app->lutDomain);
+    glBindTexture(GL_TEXTURE_2D, app->lutDomain);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, LUT_SIZE, LUT_SIZE, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    app->lutDomainLayout = -1;
+    glGenTextures(1, &app->lutTexture);
+    glBindTexture(GL_TEXTURE_2D, app->lutTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, LUT_SIZE, LUT_SIZE, 0, GL_RED, GL_FLOAT, 0);
+
+    //Start the cost model off with a guess of a nanosecond per unit and half a millisecond per image; measurements take over from there
+    glGenQueries(COST_QUERIES, app->costModel.queries);
+    app->costModel.ticksPerUnit = SDL_GetPerformanceFrequency() * 1e-9;
+    app->costModel.renderTicks = SDL_GetPerformanceFrequency() * 5e-4;
 
     return 0;
 
@@ -575,15 +1948,32 @@ static int UninitGL(APP *app) {
         glUseProgram(0);
 
         glDeleteFramebuffers(1, &app->rttFramebuffer);
+        glDeleteFramebuffers(1, &app->compositeFramebuffer);
 
         glDeleteTextures(MAX_TEXTURES, app->textures);
+        glDeleteTextures(1, &app->lutDomain);
+        glDeleteTextures(1, &app->lutTexture);
+        glDeleteQueries(COST_QUERIES, app->costModel.queries);
+        for (int x = 0; x < PREFIX_CACHE_SIZE; x++) {
+            if (app->prefixCache.entries[x].tex) glDeleteTextures(1, &app->prefixCache.entries[x].tex);
+        }
+        if (app->prefixCache.hits + app->prefixCache.misses) fprintf(stderr, "Prefix cache: %lu hits, %lu misses, %llu operators skipped\r\n", app->prefixCache.hits, app->prefixCache.misses, app->prefixCache.skippedOperators);
+        for (int x = 0; x < INSPECTOR_TILES; x++) {
+            if (app->inspector.tiles[x].tex) glDeleteTextures(1, &app->inspector.tiles[x].tex);
+        }
+        if (app->inspector.rendered) fprintf(stderr, "Inspector: %lu tiles rendered\r\n", app->inspector.rendered);
 		glDeleteBuffers(1, &app->VAB);
 		glDeleteVertexArrays(1, &app->VAO);
         glDetachShader(app->program, app->svertex);
         glDetachShader(app->program, app->sfragment);
         glDeleteShader(app->svertex);
+        glDeleteShader(app->svertexLayered);
         glDeleteShader(app->sfragment);
         glDeleteProgram(app->program);
+        glDetachShader(app->lutProgram, app->svertex);
+        glDetachShader(app->lutProgram, app->lutFragment);
+        glDeleteShader(app->lutFragment);
+        glDeleteProgram(app->lutProgram);
     }
     return 0;
 }
@@ -607,7 +1997,7 @@ static int InitSDL(APP *app) {
         SDL_WINDOWPOS_CENTERED,
         app->width,
         app->height,
-        SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE
+        SDL_WINDOW_OPENGL | (app->headless || app->session.replaying ? SDL_WINDOW_HIDDEN : SDL_WINDOW_RESIZABLE)
     );
 
     //Error checking
@@ -624,6 +2014,16 @@ static int InitSDL(APP *app) {
     }
     SDL_GL_MakeCurrent(app->window, app->gl);
 
+    //Sync buffer swaps to the display so the main loop doesn't need to spin while animating; prefer adaptive vsync so a late frame doesn't wait for yet another vertical blank
+    app->vsync = SDL_GL_SetSwapInterval(-1) == 0 || SDL_GL_SetSwapInterval(1) == 0;
+    if (!app->vsync) fprintf(stderr, "Could not enable vsync: %s\r\n", SDL_GetError());
+
+    //Replays keep their own time
+    if (app->session.replaying) {
+        SDL_GL_SetSwapInterval(0);
+        app->vsync = FALSE;
+    }
+
     return 0;
 
 //Error handling
@@ -645,221 +2045,1234 @@ static void UninitSDL(APP *app) {
 
 
 /*****************************************************************************
- *                            Animation Functions                            *
+ *                            Shader Compile Queue                           *
  *****************************************************************************/
-
-int expressionLengthLookup[255] = {3,3,3,3,16,10,6,5,   0,0,0,0,0,0,0,0, //Operators, unused operators
-                                    15,15,15,   0,0,0,0,0,0,   0,0,0,0,0,0,0, //Channels, unimplemented channels, unused channels
-                                    3,3,3,3,3,3,1,2,    5,5,5,5,5,5,3,4, //Positive constants, negative constants
-                                    };
-//These only exist for operators
-char *expressionLeftStringLookup[255] = {
-    "(", "(", "(", "(", "pow(abs(", "log(abs(", "mod(", "sin(",     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, //(+) (-) (*) (/) pow(abs(),abs()) log(abs()) mod(,) sin()    and unused operators
-};
-char *expressionMiddleStringLookup[255] = {
-    "+", "-", "*", "/", "),abs(", NULL, ",", NULL,     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, //(+) (-) (*) (/) pow(abs(),abs()) log(abs()) mod(,) sin()    and unused operators
-};
-//This exists for both operators and operands
-char *expressionRightStringLookup[255] = {
-    ")", ")", ")", ")", "))", "))", ")", ")",     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, //(+) (-) (*) (/) pow(abs(),abs()) log(abs()) mod(,) sin()    and unused operators
-    "texture(t,UV).r", "texture(t,UV).g", "texture(t,UV).b",    NULL, NULL, NULL, NULL, NULL, NULL,     NULL, NULL, NULL, NULL, NULL, NULL, NULL,  //Red, green, blue, unimplemented channels, and unused channels
-    "0.1", "0.3", "0.7", "0.9", "1.5", "2.5", "6", "10",    " -0.1", " -0.3", " -0.7", " -0.9", " -1.5", " -2.5", " -6", " -10", //Positive constants, negative constants
-};
-
-static inline void putLeft(char* src, char* dest, int* pos) {
-    int len = strlen(src);
-    memcpy(dest + *pos, src, len); //Destination, source, bytes
-    *pos += len;
-}
-
-static inline void putRight(char* src, char* dest, int* pos) {
-    int len = strlen(src);
-    memcpy(dest + *pos - len + 1, src, len); //Destination, source, bytes
-    *pos -= len;
-}
-
-//Note: the value returned from this function is DYNAMICALLY ALLOCATED, so make very sure that you free it when you're done with it!
-static char* expressionToGLSLString(unsigned char *expression, int expressionLength) {
-    //First, calculate the size of the buffer we need. We may end up with a little bit too much space (due to unary operators that are given two operands) but never too little.
-    int memoryRequirement = 0; //TODO: I actually want all of "normalizeMult*vec3(,,)+normalizeAdd\0" in the returned string.
-    for (int x = 0; x < expressionLength; x++) {
-        memoryRequirement += expressionLengthLookup[expression[x]];
-    }
-    memoryRequirement += 1 + 21 + 16 + 4; //null terminator, normalizeMult part, normalizeAdd part, and the ",1,1" I'm testing with
-
-    //Now we know roughly how long the string has to be, so we can allocate it.
-    char *buildAString = (char*)malloc(memoryRequirement);
-    //Since the second operand is always something basic rather than an expression tree, you can put the first part, i.e. "pow(abs(", at the beginning of buildAString, then
-    //you can put the rest of it, i.e. "),abs(myOperand))" at the end, then move to the previous operator. Then fill in the gap between leftPos and rightPos via memmove().
-    //  So if I had r3+2%8l (let's say that means log ((red + 3) modulo 2), and the 8 is discarded because this log is unary), it would start with "log(" at the left and ")\0" at the right, then it'd become "log(mod(" at the left of the buffer and ",2))\0" at the right, then for the next step it would become "log(mod(texture(t,UV).r+" at the left and "3,2))\0" at the right, with one unknown character in between them. Then it moves the "3,2))\0" substring so that it begins where that unknown character was, making "log(mod(texture(t,UV).r+3,2))\0\0".
-    int leftPos = 0;
-    int rightPos = memoryRequirement - 2; //Index memoryRequirement is out of bounds, index memoryRequirement - 1 is the null terminator, and index memoryRequirement - 2 is the last char.
-    buildAString[rightPos + 1] = 0;
-    //For the time being, PUT_LEFT and PUT_RIGHT are just aliases for putLeft() and putRight().
-    #define PUT_LEFT(txt) putLeft(txt,buildAString,&leftPos)
-    #define PUT_RIGHT(txt) putRight(txt,buildAString,&rightPos)
-
-    PUT_LEFT("normalizeMult * vec3(");
-    PUT_RIGHT(") + normalizeAdd");
-    PUT_RIGHT(",1,1"); //TODO: Only temporarily setting green and blue components to 1. I want to cycle the channels that appear in the expression and evaluate it 3 times, basically.
-
-    for (int x = expressionLength - 1; x > 0; x -= 2) {
-        switch(expression[x]) {
-            //Binary operators
-            case 0: case 1: case 2: case 3: case 4: case 6:
-                PUT_LEFT(expressionLeftStringLookup[expression[x]]); //Put the operator's initial part on the left
-                PUT_RIGHT(expressionRightStringLookup[expression[x]]); //Put the operator's final part on the right
-                PUT_RIGHT(expressionRightStringLookup[expression[x-1]]); //Get the second operand and put it at the right. Operands should only be listed in expressionRightStringLookup since they go on the right in this architecture.
-                PUT_RIGHT(expressionMiddleStringLookup[expression[x]]); //Put the operator's middle component on the right
-                break;
-            //Unary operators (log and sine). Unary operators are to only use expressionLeftStringLookup and expressionRightStringLookup, not Middle.
-            case 5: case 7:
-                PUT_LEFT(expressionLeftStringLookup[expression[x]]); //Put the operator's initial part on the left
-                PUT_RIGHT(expressionRightStringLookup[expression[x]]); //Put the operator's final part on the right
-                break;
-
-            default: break;
-        }
-    }
-    //TODO: After that loop is done, still need to put the last operand on the left or right, then move the right data to be adjacent to the left data.
-    //Putting something on the right and putting it on the left are equivalent when you reach the final operand, so just put it at the left.
-    PUT_LEFT(expressionRightStringLookup[expression[0]]);
-
-    memmove(buildAString + leftPos, buildAString + rightPos + 1, memoryRequirement - 1 - rightPos);
-
-    fprintf(stderr, "%s\r\n", buildAString);
-
-    return buildAString;
-}
-
-static void GenerateNewImage(APP *app) {
-    //TODO: Step 1: make a random expression, starting with operand+operand+operator (1 byte each), replacing a random operand with an operator until you're satisfied, and compare it to all existing ones.
-    //TODO: Step 2: convert the bytes into strings, which you can pass directly to RenderToTexture.
-
-    if (app->usedTextures >= MAX_TEXTURES) return; //Error check
-
-    switch (app->usedTextures - RESERVED_TEXTURES) {
-        case 0: fragmentShaderTemplate[1] = "normalizeMult * vec3(texture(t, UV).rg, 1) + normalizeAdd"; break;
-        case 1: fragmentShaderTemplate[1] = "normalizeMult * vec3(texture(t, UV).r, 1, texture(t, UV).b) + normalizeAdd"; break;
-        case 2: fragmentShaderTemplate[1] = "normalizeMult * vec3(1, texture(t, UV).gb) + normalizeAdd"; break;
-        case 3: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).bgr + normalizeAdd"; break;
-        case 4: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).rrr + normalizeAdd"; break;
-        case 5: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).ggg + normalizeAdd"; break;
-        case 6: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).bbb + normalizeAdd"; break;
-        case 7: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).gbr + normalizeAdd"; break;
-        case 8: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).brg + normalizeAdd"; break;
-        case 9: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).grb + normalizeAdd"; break;
-        case 10: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).rbr + normalizeAdd"; break;
-        case 11: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).gbg + normalizeAdd"; break;
-        case 12: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).brb + normalizeAdd"; break;
-        case 13: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).bgb + normalizeAdd"; break;
-        case 14: fragmentShaderTemplate[1] = "normalizeMult * trunc(texture(t, UV).rgb*8) + normalizeAdd"; break;
-        case 15: fragmentShaderTemplate[1] = "normalizeMult * log(texture(t, UV).rgb) + normalizeAdd"; break;
-        case 16: fragmentShaderTemplate[1] = "normalizeMult * vec3(texture(t, UV).r/2, texture(t, UV).g/3, texture(t, UV).b/4) + normalizeAdd"; break; //TODO: This one shows that we might want to normalize across all channels simultaneously...maybe.
-        case 17: fragmentShaderTemplate[1] = "normalizeMult * texture(t, UV).rgb * texture(t, UV).rgb + normalizeAdd"; break;
-        case 18: fragmentShaderTemplate[1] = "normalizeMult * vec3(mod(texture(t, UV).r, 0.5), mod(texture(t, UV).g, 0.5), mod(texture(t, UV).b, 0.5)) + normalizeAdd"; break;
-        case 19: fragmentShaderTemplate[1] = "normalizeMult * vec3(sin(texture(t, UV).r * 6.2831853), sin(texture(t, UV).g* 6.2831853), sin(texture(t, UV).b* 6.2831853)) + normalizeAdd"; break;
-    }
-
-    //Allocate memory for a randomized expression
-    //The expression will be generated in the pattern of ccOcOcOcOcOcO, where c is a constant or channel and O is an operator. This is effectively a perfectly imbalanced binary tree.
-    //If you evaluate it like a stack, the stack will only ever contain two elements at a time.
-    unsigned char expression[33]; //33 operators and operands max... may actually be a lot more than needed. That's 16 operators and 17 operands.
-    expression[0] = EXP_RANDOM_CHANNEL; //First byte must be an input channel
-    int expressionLength = 1;
-    for (int x = 1; x < 32; x++) {
-        expressionLength++;
-        //If x is odd, pick a random channel or constant
-        if (x & 1) expression[x] = EXP_RANDOM_CHANNEL_OR_CONSTANT;
-        else {
-            expression[x] = EXP_RANDOM_OPERATOR; //If x is even, pick a random operator.
-            if ((rand() & 1) == 0) break; //There's a 50% chance of not making the expression any longer after each operator.
-            /*The probability of having no more than Ops operators in an expression:
-                Ops Probability
-                1	0.5
-                2	0.75
-                3	0.875
-                4	0.9375
-                5	0.96875
-                6	0.984375
-                7	0.9921875
-                8	0.99609375
-                9	0.998046875
-                10	0.999023438
-                11	0.999511719
-                12	0.999755859
-                13	0.99987793
-                14	0.999938965
-                15	0.999969482
-                16	1.0 */
-        }
-    }
-
-    //TODO: Store the randomized expression in a struct so we can do stuff like save it to the disk and reload it and show it to the user when they click on the image generated with it.
-    fragmentShaderTemplate[1] = expressionToGLSLString(expression, expressionLength);
-
-    RenderToTexture(app, app->usedTextures++);
-    free(fragmentShaderTemplate[1]);
-    fragmentShaderTemplate[1] = "normalizeMult * vec3(texture(t, UV).rg, 1) + normalizeAdd";
-}
 
-static void Animate(APP *app) {
-    if (fabs(app->scrollVelocity) > SCROLL_STOP_THRESHOLD) {
-        app->updated = TRUE; //Tells whether render is necessary
-        //Scroll the screen
-        app->scrollMinor += app->scrollVelocity;
-        app->scrollVelocity *= 0.97f;
-        //Once you've scrolled enough, take away from scrollMinor and add/subtract from/to scrollMajor
-        if (app->scrollMinor > SCROLL_PER_ROW && app->scrollMajor < ULONG_MAX - (unsigned long int)rowsPerScreen(app)) {
-            app->scrollMajor++;
-            app->scrollMinor -= SCROLL_PER_ROW;
-
-            //TODO: Cycle off the oldest expressions/textures and generate a row of new ones (if they haven't already been generated)
-            //TODO: This little while loop will generate based on the number of used textures, so it's not for the final product. It's just for testing up to MAX_TEXTURES-RESERVED_TEXTURES images.
-            while (app->usedTextures < MAX_TEXTURES && app->usedTextures < IMAGES_PER_ROW * (app->scrollMajor + rowsPerScreen(app) + 1) + RESERVED_TEXTURES) GenerateNewImage(app);
-        }
-        else if (app->scrollMinor < 0 && app->scrollMajor > 0) {
-            app->scrollMajor--;
-            app->scrollMinor += SCROLL_PER_ROW;
-
-            //TODO: Cycle off the newest expressions/textures and reload a row of old ones
-        }
-    }
-    //Prevent scrolling above the top (smoothly!) or below the bottom (assuming it were possible to reach the bottom)
-    if (app->scrollMajor == 0 && app->scrollMinor < -SCROLL_STOP_THRESHOLD) {
-        app->scrollVelocity *= 0.9f;
-        app->scrollMinor *= 0.9f;
-        app->updated = TRUE; //Tells whether render is necessary
-    } else if (app->scrollMajor == ULONG_MAX - (unsigned long int)rowsPerScreen(app) && app->scrollMinor > SCROLL_PER_ROW + SCROLL_STOP_THRESHOLD) {
-        app->scrollVelocity *= 0.9f;
-        app->scrollMinor = SCROLL_PER_ROW + (app->scrollMinor - SCROLL_PER_ROW) * 0.9f;
-        app->updated = TRUE; //Tells whether render is necessary
-    }
-}
+//Create, compile, and link a job's shader program. Doesn't ask for the results, since that would block until the driver is done; see CheckProgram.
+static void CompileProgram(APP *app, CompileJob *job) {
+    char **template = job->layered ? layeredFragmentShaderTemplate : fragmentShaderTemplate;
+    const GLchar *source[3] = {template[0], job->source, template[2]};
 
+    job->shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(job->shader, 3, source, NULL);
+    glCompileShader(job->shader);
 
+    //Prepare shader program. Linking doesn't need to wait for the compile status; it'll just fail if the shader didn't compile.
+    job->program = glCreateProgram();
+    glAttachShader(job->program, job->layered ? app->svertexLayered : app->svertex);
+    glAttachShader(job->program, job->shader);
+    glLinkProgram(job->program);
+}
 
-/*****************************************************************************
- *                            Rendering Functions                            *
- *****************************************************************************/
+//Check whether a job's shader program compiled and linked successfully, blocking until it's done if necessary. Returns 0 on success.
+static int CheckProgram(CompileJob *job) {
+    GLint   status;
+    GLsizei length;
+    char    log[1024]; //Not LOG, because this can run on several threads at once
 
-
-//Draw a scene to OpenGL
-static void Render(APP *app) {
-	float vector[2];
-
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    //Draw the filtered textures, after rendering the filtered base image to textures
-    //TODO: Make this a circular array buffer (along with one for the expressions). Save to disk when generated; unload a row when nearing capacity. Only reload when nearing necessity, though.
-    for (int x = RESERVED_TEXTURES; x < app->usedTextures; x++) {
-        //Now draw the test texture (render-to-texture)
-        vector[0] = 270.0f * ((x - RESERVED_TEXTURES) % IMAGES_PER_ROW);
-        vector[1] = app->height + app->scrollMinor - SCROLL_PER_ROW * (1 + (x - RESERVED_TEXTURES) / IMAGES_PER_ROW) + (app->scrollMajor * SCROLL_PER_ROW); //TODO: The last part of this expression is for testing only until I start generating more rows.
-
-        if (vector[1] < -SCROLL_PER_ROW || vector[1] > app->height) continue; //Don't draw off-screen!
+    glGetShaderiv(job->shader, GL_COMPILE_STATUS, &status);
+    if (job->shader == 0 || status != GL_TRUE) {
+        fprintf(stderr, "Could not create fragment shader.\r\n");
 
-        glBindTexture(GL_TEXTURE_2D, app->textures[x]);
+        //Output shader info log
+        glGetShaderInfoLog(job->shader, sizeof log, &length, (GLchar *) &log[0]);
+        fprintf(stderr, "%s\r\n", log);
+        return 1;
+    }
+
+    glGetProgramiv(job->program, GL_LINK_STATUS, &status);
+    if (job->program == 0 || status != GL_TRUE) {
+        fprintf(stderr, "Could not create shader program.\r\n");
+        return 1;
+    }
+    return 0;
+}
+
+//Delete a job's GL objects and source
+static void DeleteCompiledProgram(APP *app, CompileJob *job) {
+    if (job->program) { //Not if the program cache took it
+        glDetachShader(job->program, job->layered ? app->svertexLayered : app->svertex);
+        glDetachShader(job->program, job->shader);
+        glDeleteShader(job->shader);
+        glDeleteProgram(job->program);
+    }
+    job->program = 0;
+    job->shader = 0;
+    free(job->source);
+    job->source = NULL;
+}
+
+//Delete a finished job's GL objects and return its slot to the queue
+static void FreeCompileJob(APP *app, CompileJob *job) {
+    DeleteCompiledProgram(app, job);
+    job->state = JOB_FREE;
+    app->compileQueue.inFlight--;
+}
+
+//Find a linked program for an expression's skeleton, or return NULL
+static CachedProgram *ProgramCacheFind(ProgramCache *cache, const unsigned char *skeleton, int length, int layered) {
+    cache->clock++;
+    for (int x = 0; x < PROGRAM_CACHE_SIZE; x++) {
+        CachedProgram *entry = &cache->entries[x];
+        if (entry->length == length && entry->job.layered == layered && !memcmp(entry->skeleton, skeleton, length)) {
+            entry->lastUsed = cache->clock;
+            cache->hits++;
+            return entry;
+        }
+    }
+    cache->misses++;
+    return NULL;
+}
+
+//Give a successfully linked job's program to the cache, replacing the least recently used one if it's full. Returns 1 (and leaves the job alone) if the cache already has a program for the same skeleton.
+//prefixLength is the part of the expression that the program reads from the prefix cache, as for ExpressionSkeleton.
+static int ProgramCacheAdd(APP *app, CompileJob *job, const unsigned char *expression, int length, int prefixLength) {
+    ProgramCache *cache = &app->programCache;
+    CachedProgram *entry = &cache->entries[0];
+    unsigned char skeleton[MAX_EXPRESSION_LENGTH];
+
+    ExpressionSkeleton(expression, length, prefixLength, skeleton);
+    for (int x = 0; x < PROGRAM_CACHE_SIZE; x++) {
+        CachedProgram *other = &cache->entries[x];
+        if (other->length == length && other->job.layered == job->layered && !memcmp(other->skeleton, skeleton, length)) return 1;
+        if (other->lastUsed < entry->lastUsed) entry = other;
+    }
+
+    DeleteCompiledProgram(app, &entry->job);
+    memcpy(entry->skeleton, skeleton, length);
+    entry->length = length;
+    entry->job = *job;
+    entry->job.source = NULL;
+    entry->lastUsed = ++cache->clock;
+
+    free(job->source);
+    job->source = NULL;
+    job->program = 0;
+    job->shader = 0;
+    return 0;
+}
+
+//Worker thread body: compile and link queued jobs in a context that shares objects with the main one
+static int CompileWorker(void *data) {
+    APP *app = (APP*)data;
+    CompileQueue *queue = &app->compileQueue;
+
+    SDL_LockMutex(queue->lock);
+    SDL_GL_MakeCurrent(app->window, queue->contexts[queue->nextThread++]);
+    while (!queue->quit) {
+        CompileJob *job = NULL;
+        for (int x = 0; x < COMPILE_QUEUE_SIZE && !job; x++) {
+            if (queue->jobs[x].state == JOB_QUEUED) job = &queue->jobs[x];
+        }
+        if (!job) {
+            SDL_CondWait(queue->wake, queue->lock);
+            continue;
+        }
+
+        job->state = JOB_COMPILING;
+        SDL_UnlockMutex(queue->lock);
+        CompileProgram(app, job);
+        int failed = CheckProgram(job);
+        glFinish(); //Make sure the linked program is complete before the main context picks it up
+        SDL_LockMutex(queue->lock);
+
+        job->state = failed ? JOB_FAILED : JOB_LINKED;
+        SDL_CondBroadcast(queue->wake);
+    }
+    SDL_UnlockMutex(queue->lock);
+    SDL_GL_MakeCurrent(app->window, NULL);
+    return 0;
+}
+
+//Set up parallel shader compilation, preferring the driver's own over worker threads. Must be called after InitGL.
+static int InitCompileQueue(APP *app) {
+    CompileQueue *queue = &app->compileQueue;
+
+    queue->lock = SDL_CreateMutex();
+    queue->wake = SDL_CreateCond();
+    if (!queue->lock || !queue->wake) {
+        fprintf(stderr, "Could not create compile queue lock: %s\r\n", SDL_GetError());
+        return 1;
+    }
+
+    //KHR_parallel_shader_compile: compile and link calls return immediately, and GL_COMPLETION_STATUS_KHR tells us when it's safe to query the results without blocking
+    if (SDL_GL_ExtensionSupported("GL_KHR_parallel_shader_compile"))
+        *(void **)&glMaxShaderCompilerThreadsKHR = SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if (SDL_GL_ExtensionSupported("GL_ARB_parallel_shader_compile")) //Same enum value (GL_COMPLETION_STATUS_ARB) and function signature
+        *(void **)&glMaxShaderCompilerThreadsKHR = SDL_GL_GetProcAddress("glMaxShaderCompilerThreadsARB");
+    if (glMaxShaderCompilerThreadsKHR) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); //Let the driver decide how many threads to use
+        queue->parallelCompile = TRUE;
+        return 0;
+    }
+
+    //Otherwise, spin up worker threads, each with its own context in the same share group. Farm workers only render one image at a time, and there's already a process per core.
+    int threads = app->farmWorker ? 0 : SDL_GetCPUCount() - 1;
+    if (threads > MAX_COMPILE_THREADS) threads = MAX_COMPILE_THREADS;
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+    for (int x = 0; x < threads; x++) {
+        queue->contexts[x] = SDL_GL_CreateContext(app->window); //This also makes the new context current
+        if (!queue->contexts[x]) break;
+        queue->threadCount++;
+    }
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+    SDL_GL_MakeCurrent(app->window, app->gl);
+
+    for (int x = 0; x < queue->threadCount; x++) {
+        queue->threads[x] = SDL_CreateThread(CompileWorker, "CompileWorker", app);
+        if (!queue->threads[x]) {
+            //The contexts without a thread just go unused
+            fprintf(stderr, "Could not create compile thread: %s\r\n", SDL_GetError());
+            queue->threadCount = x;
+            break;
+        }
+    }
+    //If there are no worker threads either, SubmitCompileJob just compiles synchronously
+    return 0;
+}
+
+//Stop the worker threads and delete anything left in the queue
+static void UninitCompileQueue(APP *app) {
+    CompileQueue *queue = &app->compileQueue;
+
+    if (queue->lock) {
+        SDL_LockMutex(queue->lock);
+        queue->quit = TRUE;
+        SDL_CondBroadcast(queue->wake);
+        SDL_UnlockMutex(queue->lock);
+    }
+    for (int x = 0; x < MAX_COMPILE_THREADS; x++) {
+        if (queue->threads[x]) SDL_WaitThread(queue->threads[x], NULL);
+        if (queue->contexts[x]) SDL_GL_DeleteContext(queue->contexts[x]);
+        queue->threads[x] = NULL;
+        queue->contexts[x] = NULL;
+    }
+    if (app->gl) SDL_GL_MakeCurrent(app->window, app->gl);
+
+    for (int x = 0; x < COMPILE_QUEUE_SIZE; x++) {
+        if (queue->jobs[x].state != JOB_FREE) FreeCompileJob(app, &queue->jobs[x]);
+    }
+    for (int x = 0; x < PROGRAM_CACHE_SIZE; x++) DeleteCompiledProgram(app, &app->programCache.entries[x].job);
+    DeleteCompiledProgram(app, &app->inspector.job);
+    if (app->programCache.hits + app->programCache.misses) fprintf(stderr, "Program cache: %lu hits, %lu misses\r\n", app->programCache.hits, app->programCache.misses);
+    if (queue->wake) SDL_DestroyCond(queue->wake);
+    if (queue->lock) SDL_DestroyMutex(queue->lock);
+    queue->wake = NULL;
+    queue->lock = NULL;
+}
+
+//Throw out a tile's expression after screening rejects it, so the scheduler picks another
+static void RejectImage(APP *app, int textureIdx) {
+    GeneratedImage *image = &app->images[textureIdx];
+    free(image->eR);
+    image->eR = NULL;
+    image->state = TILE_PENDING;
+}
+
+//Render every job whose program has finished linking, then keep the program for later expressions with the same skeleton. If wait is true and nothing is finished yet, block until something is.
+//If deadline (in performance counter ticks) isn't 0, jobs whose predicted cost would run past it are left for a later call, unless nothing has been rendered yet this frame (see app->frameWork). Jobs for tiles that have scrolled off the top aren't rendered at all.
+static void FinishCompileJobs(APP *app, int wait, uint64_t deadline) {
+    CompileQueue *queue = &app->compileQueue;
+    int finished = 0, outOfTime = FALSE;
+    GLint done;
+
+    SDL_LockMutex(queue->lock);
+    for (;;) {
+        for (int x = 0; x < COMPILE_QUEUE_SIZE; x++) {
+            CompileJob *job = &queue->jobs[x];
+
+            //Ask the driver whether it's done, without blocking
+            if (queue->parallelCompile && job->state == JOB_COMPILING) {
+                glGetProgramiv(job->program, GL_COMPLETION_STATUS_KHR, &done);
+                if (done) job->state = CheckProgram(job) ? JOB_FAILED : JOB_LINKED;
+            }
+
+            if (job->state == JOB_LINKED) {
+                GeneratedImage *image = &app->images[job->textureIdx];
+                int rejected = FALSE, cancelled = tileDistance(app, job->textureIdx) < 0;
+                if (!cancelled && deadline && app->frameWork && (outOfTime || SDL_GetPerformanceCounter() + PredictCost(app, image) > deadline)) {
+                    if (!outOfTime) app->costModel.deferred++;
+                    outOfTime = TRUE;
+                    continue;
+                }
+
+                //Render without the lock, so the worker threads can finish and pick up other jobs meanwhile
+                job->state = JOB_RENDERING;
+                SDL_UnlockMutex(queue->lock);
+                if (cancelled) {
+                    //The program goes to the cache, so it's ready if the tile comes back into view
+                    ReleasePrefix(app, image);
+                    image->state = TILE_IDLE;
+                    app->costModel.cancelled++;
+                } else {
+                    app->frameWork++;
+                    if (RenderToTexture(app, job->program, job->textureIdx) != SCREEN_ACCEPTED) rejected = TRUE;
+                    else {
+                        image->ready = TRUE;
+                        image->state = TILE_IDLE;
+                        DamageTile(app, job->textureIdx); //Only the new image needs to be drawn, unless something else moved
+                    }
+                }
+                ProgramCacheAdd(app, job, image->eR, image->lengthR, image->prefixLength); //Even if screening rejected it, since other constants may work
+                if (rejected) RejectImage(app, job->textureIdx); //Only after the cache has the expression's skeleton, since this frees it
+                SDL_LockMutex(queue->lock);
+            }
+            if (job->state == JOB_FAILED) {
+                ReleasePrefix(app, &app->images[job->textureIdx]);
+                RejectImage(app, job->textureIdx);
+            }
+            if (job->state == JOB_RENDERING || job->state == JOB_FAILED) {
+                FreeCompileJob(app, job);
+                finished++;
+            }
+        }
+        if (finished || !wait || !queue->inFlight) break;
+
+        //Nothing is ready, but the caller needs a free slot
+        if (queue->threadCount) SDL_CondWait(queue->wake, queue->lock);
+        else {
+            for (int x = 0; x < COMPILE_QUEUE_SIZE; x++) {
+                if (queue->jobs[x].state == JOB_COMPILING) {
+                    queue->jobs[x].state = CheckProgram(&queue->jobs[x]) ? JOB_FAILED : JOB_LINKED; //Blocks until the driver is done
+                    break;
+                }
+            }
+        }
+    }
+    SDL_UnlockMutex(queue->lock);
+}
+
+//Queue a fragment shader (the component that goes in fragmentShaderTemplate[1], which the queue takes ownership of) to be compiled and then rendered to app->textures[textureIdx]
+static void SubmitCompileJob(APP *app, char *source, int textureIdx) {
+    CompileQueue *queue = &app->compileQueue;
+    CompileJob *job = NULL;
+
+    //Make room if the queue is full. ScheduleGeneration never lets it get that far, so this is only for the farm, which has no frame budget.
+    if (queue->inFlight >= COMPILE_QUEUE_SIZE) FinishCompileJobs(app, TRUE, 0);
+
+    SDL_LockMutex(queue->lock);
+    for (int x = 0; x < COMPILE_QUEUE_SIZE && !job; x++) {
+        if (queue->jobs[x].state == JOB_FREE) job = &queue->jobs[x];
+    }
+    job->source = source;
+    job->textureIdx = textureIdx;
+    queue->inFlight++;
+
+    if (queue->parallelCompile) {
+        CompileProgram(app, job); //Returns immediately; FinishCompileJobs polls for completion
+        job->state = JOB_COMPILING;
+    } else if (queue->threadCount) {
+        job->state = JOB_QUEUED;
+        SDL_CondSignal(queue->wake);
+    } else {
+        CompileProgram(app, job);
+        job->state = CheckProgram(job) ? JOB_FAILED : JOB_LINKED;
+    }
+    SDL_UnlockMutex(queue->lock);
+}
+
+
+
+/*****************************************************************************
+ *                              Export Functions                             *
+ *****************************************************************************/
+
+//Fill in the table that Crc32 uses. Needed before any PNG is written.
+static void InitCrcTable(void) {
+    for (uint32_t x = 0; x < 256; x++) {
+        uint32_t crc = x;
+        for (int y = 0; y < 8; y++) crc = crc & 1 ? 0xEDB88320 ^ (crc >> 1) : crc >> 1;
+        crcTable[x] = crc;
+    }
+}
+
+//CRC-32 as PNG uses it, for one more chunk of data
+static uint32_t Crc32(uint32_t crc, const unsigned char *data, size_t length) {
+    crc = ~crc;
+    for (size_t x = 0; x < length; x++) crc = crcTable[(crc ^ data[x]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static inline void putBigEndian32(unsigned char *dest, uint32_t value) {
+    dest[0] = (unsigned char)(value >> 24);
+    dest[1] = (unsigned char)(value >> 16);
+    dest[2] = (unsigned char)(value >> 8);
+    dest[3] = (unsigned char)value;
+}
+
+//Write one PNG chunk: length, type, data, and the CRC of the type and data
+static int WritePNGChunk(FILE *file, const char *type, const unsigned char *data, uint32_t length) {
+    unsigned char header[8], crc[4];
+
+    putBigEndian32(header, length);
+    memcpy(header + 4, type, 4);
+    putBigEndian32(crc, Crc32(Crc32(0, header + 4, 4), data, length));
+    return fwrite(header, 8, 1, file) != 1 || (length && fwrite(data, length, 1, file) != 1) || fwrite(crc, 4, 1, file) != 1;
+}
+
+//Save RGB pixels, bottom row first as OpenGL stores them, as a PNG. The image data is stored in uncompressed deflate blocks, so this needs no zlib and takes about as long as copying it. Returns 0 on success.
+static int WritePNG(const char *filename, const unsigned char *pixels, int width, int height) {
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    unsigned char header[13];
+    size_t rowLength = (size_t)width * 3 + 1; //Each row starts with its filter type (0, none)
+    size_t rawLength = rowLength * height;
+    size_t blocks = (rawLength + 0xFFFE) / 0xFFFF; //Stored deflate blocks hold at most 65535 bytes
+    size_t length = 2 + rawLength + blocks * 5 + 4; //zlib header, data, block headers, Adler-32
+    unsigned char *data = (unsigned char*)malloc(length);
+    FILE *file = NULL;
+    int failed = 1;
+
+    if (!data) goto catch;
+
+    //zlib stream: header (deflate, 32K window, no compression), stored blocks, then the Adler-32 of the uncompressed data
+    unsigned char *out = data;
+    uint32_t a = 1, b = 0;
+    size_t blockLeft = 0, rawLeft = rawLength;
+    *out++ = 0x78;
+    *out++ = 0x01;
+    for (int y = height - 1; y >= 0; y--) {
+        const unsigned char *row = pixels + (size_t)y * width * 3;
+        for (size_t x = 0; x < rowLength; x++) {
+            if (!blockLeft) {
+                blockLeft = rawLeft < 0xFFFF ? rawLeft : 0xFFFF;
+                *out++ = rawLeft == blockLeft; //BFINAL on the last block, BTYPE 00 (stored)
+                *out++ = (unsigned char)blockLeft;
+                *out++ = (unsigned char)(blockLeft >> 8);
+                *out++ = (unsigned char)~blockLeft;
+                *out++ = (unsigned char)(~blockLeft >> 8);
+            }
+            unsigned char value = x ? row[x - 1] : 0;
+            *out++ = value;
+            a = (a + value) % 65521;
+            b = (b + a) % 65521;
+            blockLeft--;
+            rawLeft--;
+        }
+    }
+    putBigEndian32(out, (b << 16) | a);
+
+    putBigEndian32(header, width);
+    putBigEndian32(header + 4, height);
+    header[8] = 8; //Bits per channel
+    header[9] = 2; //RGB
+    header[10] = header[11] = header[12] = 0; //Deflate, adaptive filtering, not interlaced
+
+    if (!(file = fopen(filename, "wb"))) goto catch;
+    failed = fwrite(signature, sizeof signature, 1, file) != 1 ||
+        WritePNGChunk(file, "IHDR", header, sizeof header) ||
+        WritePNGChunk(file, "IDAT", data, (uint32_t)length) ||
+        WritePNGChunk(file, "IEND", NULL, 0);
+
+catch:
+    if (file && fclose(file)) failed = 1;
+    free(data);
+    return failed;
+}
+
+//Write an export job's image and its sidecar, as <job->name>.png and <job->name>.txt. Returns 0 on success.
+static int WriteExport(ExportJob *job) {
+    char filename[sizeof job->name + 4];
+    FILE *file;
+
+    snprintf(filename, sizeof filename, "%s.png", job->name);
+    if (WritePNG(filename, job->pixels, job->size, job->size)) {
+        fprintf(stderr, "Could not write %s.\r\n", filename);
+        return 1;
+    }
+
+    //The sidecar has everything needed to render the image again
+    snprintf(filename, sizeof filename, "%s.txt", job->name);
+    if (!(file = fopen(filename, "w"))) {
+        fprintf(stderr, "Could not write %s.\r\n", filename);
+        return 1;
+    }
+    fprintf(file, "expression ");
+    PrintExpression(file, job->expression, job->expressionLength);
+    fprintf(file, "\nsize %d\nnormalizeMult %.9g %.9g %.9g\nnormalizeAdd %.9g %.9g %.9g\n", job->size,
+        job->normalizeMult[0], job->normalizeMult[1], job->normalizeMult[2],
+        job->normalizeAdd[0], job->normalizeAdd[1], job->normalizeAdd[2]);
+    return fclose(file) != 0;
+}
+
+//Worker thread body: encode and write out jobs whose pixels have been read back
+static int ExportWorker(void *data) {
+    ExportQueue *queue = (ExportQueue*)data;
+
+    SDL_LockMutex(queue->lock);
+    for (;;) {
+        ExportJob *job = NULL;
+        for (int x = 0; x < EXPORT_QUEUE_SIZE && !job; x++) {
+            if (queue->jobs[x].state == EXPORT_ENCODING) job = &queue->jobs[x];
+        }
+        if (!job) {
+            if (queue->quit) break; //Only once everything has been written
+            SDL_CondWait(queue->wake, queue->lock);
+            continue;
+        }
+
+        job->state = EXPORT_WRITING;
+        SDL_UnlockMutex(queue->lock);
+        WriteExport(job);
+        free(job->pixels);
+        job->pixels = NULL;
+        SDL_LockMutex(queue->lock);
+        job->state = EXPORT_FREE;
+        queue->pending--;
+    }
+    SDL_UnlockMutex(queue->lock);
+    return 0;
+}
+
+//Name an export after its expression's hex, with a number added if that's taken by a file from before or by another export still in the queue, so that nothing gets overwritten and no two workers write the same file. Needs the queue's lock.
+static void ExportName(ExportQueue *queue, ExportJob *job) {
+    char filename[sizeof job->name + 4];
+    int length = 0;
+
+    for (int x = 0; x < job->expressionLength; x++) length += snprintf(job->name + length, sizeof job->name - length, "%02x", job->expression[x]);
+    for (int number = 2;; number++) {
+        int taken = FALSE;
+        for (int x = 0; x < EXPORT_QUEUE_SIZE && !taken; x++) {
+            taken = &queue->jobs[x] != job && queue->jobs[x].state != EXPORT_FREE && !strcmp(queue->jobs[x].name, job->name);
+        }
+        snprintf(filename, sizeof filename, "%s.png", job->name);
+        FILE *file = taken ? NULL : fopen(filename, "rb");
+        if (file) fclose(file);
+        else if (!taken) return;
+        snprintf(job->name + length, sizeof job->name - length, "-%d", number);
+    }
+}
+
+//Start reading an image back into a pixel buffer object. Nothing waits for it; PollExports picks it up once the fence says it's done.
+static void ExportImage(APP *app, int textureIdx) {
+    ExportQueue *queue = &app->exportQueue;
+    GeneratedImage *image = &app->images[textureIdx];
+    ExportJob *job = NULL;
+    int size = app->inputImageSize;
+
+    SDL_LockMutex(queue->lock);
+    for (int x = 0; x < EXPORT_QUEUE_SIZE && !job; x++) {
+        if (queue->jobs[x].state == EXPORT_FREE) job = &queue->jobs[x];
+    }
+    if (job) {
+        memcpy(job->expression, image->eR, image->lengthR);
+        job->expressionLength = image->lengthR;
+        ExportName(queue, job);
+        job->state = EXPORT_READING;
+        queue->pending++;
+    }
+    SDL_UnlockMutex(queue->lock);
+    if (!job) {
+        fprintf(stderr, "Too many exports in progress.\r\n");
+        return;
+    }
+
+    memcpy(job->normalizeMult, image->normalizeMult, sizeof job->normalizeMult);
+    memcpy(job->normalizeAdd, image->normalizeAdd, sizeof job->normalizeAdd);
+    job->size = size;
+
+    if (!job->pbo) glGenBuffers(1, &job->pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, job->pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)size * size * 3, NULL, GL_STREAM_READ);
+    glBindFramebuffer(GL_FRAMEBUFFER, app->rttFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, image->tex, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, size, size, GL_RGB, GL_UNSIGNED_BYTE, (void*)0); //Into the buffer object, so this returns right away
+    job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+//Hand every readback that has finished to the worker threads. If wait is true, block until all of them have.
+static void PollExports(APP *app, int wait) {
+    ExportQueue *queue = &app->exportQueue;
+
+    for (int x = 0; x < EXPORT_QUEUE_SIZE; x++) {
+        ExportJob *job = &queue->jobs[x];
+        if (job->state != EXPORT_READING) continue; //Only this thread moves jobs out of EXPORT_READING, so no lock is needed to check
+        GLenum status = glClientWaitSync(job->fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+        glDeleteSync(job->fence);
+        job->fence = 0;
+
+        //Copy the pixels out so the buffer object can be reused while the workers take their time
+        size_t length = (size_t)job->size * job->size * 3;
+        void *mapped;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, job->pbo);
+        if ((job->pixels = (unsigned char*)malloc(length)) && (mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, length, GL_MAP_READ_BIT))) {
+            memcpy(job->pixels, mapped, length);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            fprintf(stderr, "Could not read back an exported image.\r\n");
+            free(job->pixels);
+            job->pixels = NULL;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        SDL_LockMutex(queue->lock);
+        if (job->pixels && queue->threadCount) {
+            job->state = EXPORT_ENCODING;
+            SDL_CondSignal(queue->wake);
+        } else {
+            //No workers to give it to, so write it here
+            if (job->pixels) WriteExport(job);
+            free(job->pixels);
+            job->pixels = NULL;
+            job->state = EXPORT_FREE;
+            queue->pending--;
+        }
+        SDL_UnlockMutex(queue->lock);
+    }
+}
+
+//Returns 0 on success
+static int InitExportQueue(APP *app) {
+    ExportQueue *queue = &app->exportQueue;
+
+    InitCrcTable();
+    queue->lock = SDL_CreateMutex();
+    queue->wake = SDL_CreateCond();
+    if (!queue->lock || !queue->wake) {
+        fprintf(stderr, "Could not create export queue lock: %s\r\n", SDL_GetError());
+        return 1;
+    }
+    for (int x = 0; x < EXPORT_THREADS; x++) {
+        if (!(queue->threads[x] = SDL_CreateThread(ExportWorker, "ExportWorker", queue))) {
+            fprintf(stderr, "Could not create export thread: %s\r\n", SDL_GetError());
+            break; //PollExports writes the files itself if there are no threads
+        }
+        queue->threadCount++;
+    }
+    return 0;
+}
+
+//Finish every export in progress, then stop the worker threads
+static void UninitExportQueue(APP *app) {
+    ExportQueue *queue = &app->exportQueue;
+
+    if (queue->lock) {
+        PollExports(app, TRUE);
+        SDL_LockMutex(queue->lock);
+        queue->quit = TRUE;
+        SDL_CondBroadcast(queue->wake);
+        SDL_UnlockMutex(queue->lock);
+    }
+    for (int x = 0; x < EXPORT_THREADS; x++) {
+        if (queue->threads[x]) SDL_WaitThread(queue->threads[x], NULL);
+        queue->threads[x] = NULL;
+    }
+    for (int x = 0; x < EXPORT_QUEUE_SIZE; x++) {
+        if (queue->jobs[x].pbo) glDeleteBuffers(1, &queue->jobs[x].pbo);
+        queue->jobs[x].pbo = 0;
+    }
+    if (queue->wake) SDL_DestroyCond(queue->wake);
+    if (queue->lock) SDL_DestroyMutex(queue->lock);
+    queue->wake = NULL;
+    queue->lock = NULL;
+}
+
+
+
+/*****************************************************************************
+ *                            Animation Functions                            *
+ *****************************************************************************/
+
+int expressionLengthLookup[255] = {3,3,3,3,16,10,6,5,   0,0,0,0,0,0,0,0, //Operators, unused operators
+                                    4,4,4,   0,0,0,0,0,0,   0,0,0,0,0,0,0, //Channels, unimplemented channels, unused channels
+                                    13,13,13,13,13,13,13,13,    13,13,13,13,13,13,13,13, //Positive constants, negative constants (written as "constants[NN]")
+                                    };
+//These only exist for operators
+char *expressionLeftStringLookup[255] = {
+    "(", "(", "(", "(", "pow(abs(", "log(abs(", "mod(", "sin(",     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, //(+) (-) (*) (/) pow(abs(),abs()) log(abs()) mod(,) sin()    and unused operators
+};
+char *expressionMiddleStringLookup[255] = {
+    "+", "-", "*", "/", "),abs(", NULL, ",", NULL,     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, //(+) (-) (*) (/) pow(abs(),abs()) log(abs()) mod(,) sin()    and unused operators
+};
+//This exists for both operators and operands
+char *expressionRightStringLookup[255] = {
+    ")", ")", ")", ")", "))", "))", ")", ")",     NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, //(+) (-) (*) (/) pow(abs(),abs()) log(abs()) mod(,) sin()    and unused operators
+    "px.r", "px.g", "px.b",    NULL, NULL, NULL, NULL, NULL, NULL,     NULL, NULL, NULL, NULL, NULL, NULL, NULL,  //Red, green, blue, unimplemented channels, and unused channels
+    "0.1", "0.3", "0.7", "0.9", "1.5", "2.5", "6", "10",    " -0.1", " -0.3", " -0.7", " -0.9", " -1.5", " -2.5", " -6", " -10", //Positive constants, negative constants; only for printing, since shaders read them from uniforms (see ExpressionConstants)
+};
+
+static inline void putLeft(char* src, char* dest, int* pos) {
+    int len = strlen(src);
+    memcpy(dest + *pos, src, len); //Destination, source, bytes
+    *pos += len;
+}
+
+static inline void putRight(char* src, char* dest, int* pos) {
+    int len = strlen(src);
+    memcpy(dest + *pos - len + 1, src, len); //Destination, source, bytes
+    *pos -= len;
+}
+
+//Note: the value returned from this function is DYNAMICALLY ALLOCATED, so make very sure that you free it when you're done with it!
+//If prefixLength isn't 0, the first prefixLength bytes of the expression aren't evaluated; the template's prefixValue is used in their place (see PrefixCacheFind).
+static char* expressionToGLSLString(unsigned char *expression, int expressionLength, int prefixLength) {
+    //First, calculate the size of the buffer we need. We may end up with a little bit too much space (due to unary operators that are given two operands, or a prefix) but never too little.
+    int memoryRequirement = 0;
+    for (int x = 0; x < expressionLength; x++) {
+        memoryRequirement += expressionLengthLookup[expression[x]];
+    }
+    memoryRequirement += 1 + 11; //null terminator and "prefixValue"
+
+    //Now we know roughly how long the string has to be, so we can allocate it.
+    char *buildAString = (char*)malloc(memoryRequirement);
+    //Since the second operand is always something basic rather than an expression tree, you can put the first part, i.e. "pow(abs(", at the beginning of buildAString, then
+    //you can put the rest of it, i.e. "),abs(myOperand))" at the end, then move to the previous operator. Then fill in the gap between leftPos and rightPos via memmove().
+    //  So if I had r3+2%8l (let's say that means log ((red + 3) modulo 2), and the 8 is discarded because this log is unary), it would start with "log(" at the left and ")\0" at the right, then it'd become "log(mod(" at the left of the buffer and ",2))\0" at the right, then for the next step it would become "log(mod(texture(t,UV).r+" at the left and "3,2))\0" at the right, with one unknown character in between them. Then it moves the "3,2))\0" substring so that it begins where that unknown character was, making "log(mod(texture(t,UV).r+3,2))\0\0".
+    int leftPos = 0;
+    int rightPos = memoryRequirement - 2; //Index memoryRequirement is out of bounds, index memoryRequirement - 1 is the null terminator, and index memoryRequirement - 2 is the last char.
+    buildAString[rightPos + 1] = 0;
+    //For the time being, PUT_LEFT and PUT_RIGHT are just aliases for putLeft() and putRight().
+    #define PUT_LEFT(txt) putLeft(txt,buildAString,&leftPos)
+    #define PUT_RIGHT(txt) putRight(txt,buildAString,&rightPos)
+
+    char constant[24]; //Big enough for "constants[%d]" with any int
+    for (int x = expressionLength - 1; x > prefixLength; x -= 2) {
+        switch(expression[x]) {
+            //Binary operators
+            case 0: case 1: case 2: case 3: case 4: case 6:
+                PUT_LEFT(expressionLeftStringLookup[expression[x]]); //Put the operator's initial part on the left
+                PUT_RIGHT(expressionRightStringLookup[expression[x]]); //Put the operator's final part on the right
+                //Get the second operand and put it at the right. Operands should only be listed in expressionRightStringLookup since they go on the right in this architecture.
+                //Constants become uniform slots instead, numbered by their position in the expression.
+                if ((expression[x-1] & 0xF0) == 0x20) {
+                    snprintf(constant, sizeof constant, "constants[%d]", (x - 1) / 2);
+                    PUT_RIGHT(constant);
+                } else PUT_RIGHT(expressionRightStringLookup[expression[x-1]]);
+                PUT_RIGHT(expressionMiddleStringLookup[expression[x]]); //Put the operator's middle component on the right
+                break;
+            //Unary operators (log and sine). Unary operators are to only use expressionLeftStringLookup and expressionRightStringLookup, not Middle.
+            case 5: case 7:
+                PUT_LEFT(expressionLeftStringLookup[expression[x]]); //Put the operator's initial part on the left
+                PUT_RIGHT(expressionRightStringLookup[expression[x]]); //Put the operator's final part on the right
+                break;
+
+            default: break;
+        }
+    }
+    //TODO: After that loop is done, still need to put the last operand on the left or right, then move the right data to be adjacent to the left data.
+    //Putting something on the right and putting it on the left are equivalent when you reach the final operand, so just put it at the left.
+    PUT_LEFT(prefixLength ? "prefixValue" : expressionRightStringLookup[expression[0]]);
+
+    memmove(buildAString + leftPos, buildAString + rightPos + 1, memoryRequirement - 1 - rightPos);
+
+    fprintf(stderr, "%s\r\n", buildAString);
+
+    return buildAString;
+}
+
+//Fill expression (which must have room for MAX_EXPRESSION_LENGTH bytes) with a random expression and return its length
+static int RandomExpression(unsigned char *expression) {
+    //The expression will be generated in the pattern of ccOcOcOcOcOcO, where c is a constant or channel and O is an operator. This is effectively a perfectly imbalanced binary tree.
+    //If you evaluate it like a stack, the stack will only ever contain two elements at a time.
+    expression[0] = EXP_RANDOM_CHANNEL; //First byte must be an input channel
+    int expressionLength = 1;
+    for (int x = 1; x < MAX_EXPRESSION_LENGTH; x++) {
+        expressionLength++;
+        //If x is odd, pick a random channel or constant
+        if (x & 1) expression[x] = EXP_RANDOM_CHANNEL_OR_CONSTANT;
+        else {
+            expression[x] = EXP_RANDOM_OPERATOR; //If x is even, pick a random operator.
+            if ((rand() & 1) == 0) break; //There's a 50% chance of not making the expression any longer after each operator.
+            /*The probability of having no more than Ops operators in an expression:
+                Ops Probability
+                1	0.5
+                2	0.75
+                3	0.875
+                4	0.9375
+                5	0.96875
+                6	0.984375
+                7	0.9921875
+                8	0.99609375
+                9	0.998046875
+                10	0.999023438
+                11	0.999511719
+                12	0.999755859
+                13	0.99987793
+                14	0.999938965
+                15	0.999969482
+                16	1.0 */
+        }
+    }
+    return expressionLength;
+}
+
+//Make a child of an expression that keeps all of it and adds one or two operators to the end, so it can be drawn from the parent's raw output in the prefix cache. Returns the child's length.
+static int ExtendExpression(const unsigned char *parent, int length, unsigned char *child) {
+    int steps = 1 + randomi(2);
+    if (length + 2 > MAX_EXPRESSION_LENGTH) length -= 2; //No room to add anything, so replace the last operator instead
+    memcpy(child, parent, length);
+    for (int x = 0; x < steps && length + 2 <= MAX_EXPRESSION_LENGTH; x++) {
+        child[length++] = EXP_RANDOM_CHANNEL_OR_CONSTANT;
+        child[length++] = EXP_RANDOM_OPERATOR;
+    }
+    return length;
+}
+
+//Make an expression for app->images[textureIdx]
+static void ChooseExpression(APP *app, int textureIdx) {
+    //TODO: Step 1: make a random expression, starting with operand+operand+operator (1 byte each), replacing a random operand with an operator until you're satisfied, and compare it to all existing ones.
+
+    //Allocate memory for a randomized expression, unless there are suggestions left from the last "more like this" request
+    unsigned char expression[MAX_EXPRESSION_LENGTH]; //33 operators and operands max... may actually be a lot more than needed. That's 16 operators and 17 operands.
+    int expressionLength;
+    if (app->suggestionCount) {
+        app->suggestionCount--;
+        expressionLength = app->suggestionLengths[app->suggestionCount];
+        memcpy(expression, app->suggestions[app->suggestionCount], expressionLength);
+    } else expressionLength = RandomExpression(expression);
+
+    //Keep the expression with the image so we can do stuff like save it to the disk and reload it and show it to the user when they click on the image generated with it.
+    GeneratedImage *image = &app->images[textureIdx];
+    image->tex = app->textures[textureIdx];
+    image->eR = (unsigned char*)malloc(expressionLength); //Screening frees the last one when it rejects it (see RejectImage)
+    memcpy(image->eR, expression, expressionLength);
+    image->lengthR = expressionLength;
+    image->ready = FALSE;
+}
+
+//Draw app->images[textureIdx]'s expression, or queue it to be drawn once its program is compiled
+static void GenerateImage(APP *app, int textureIdx) {
+    GeneratedImage *image = &app->images[textureIdx];
+    unsigned char *expression = image->eR;
+    int expressionLength = image->lengthR;
+
+    //If it starts with an expression whose raw output is still around, only the rest of it has to be evaluated. That doesn't apply to lookup tables, which are baked from other input values.
+    image->prefix = LUTChannels(app, expression, expressionLength) ? -1 : PrefixCacheFind(&app->prefixCache, expression, expressionLength);
+    image->prefixLength = image->prefix >= 0 ? app->prefixCache.entries[image->prefix].length : 0;
+
+    //Draw it right away if there's already a program for the same skeleton
+    unsigned char skeleton[MAX_EXPRESSION_LENGTH];
+    ExpressionSkeleton(expression, expressionLength, image->prefixLength, skeleton);
+    CachedProgram *cached = ProgramCacheFind(&app->programCache, skeleton, expressionLength, FALSE);
+    if (cached) {
+        if (RenderToTexture(app, cached->job.program, textureIdx) != SCREEN_ACCEPTED) RejectImage(app, textureIdx);
+        else {
+            image->ready = TRUE;
+            image->state = TILE_IDLE;
+            DamageTile(app, textureIdx);
+        }
+        return;
+    }
+
+    //Otherwise, the image is drawn once its shader finishes compiling; see FinishCompileJobs
+    image->state = TILE_COMPILING;
+    SubmitCompileJob(app, expressionToGLSLString(expression, expressionLength, image->prefixLength), textureIdx);
+}
+
+//Add a tile for the scheduler to generate
+static void GenerateNewImage(APP *app) {
+    if (app->usedTextures >= MAX_TEXTURES) return; //Error check
+
+    GeneratedImage *image = &app->images[app->usedTextures++];
+    image->rejections = 0;
+    image->state = TILE_PENDING;
+}
+
+//Generate pending tiles, nearest the viewport first, for as long as their predicted cost fits before deadline (in performance counter ticks). If nothing has been rendered yet this frame, one is generated anyway, so an expensive one can't hold everything up.
+//Pending tiles that have scrolled off the top are cancelled, and cancelled ones that come back into view are pending again.
+static void ScheduleGeneration(APP *app, uint64_t deadline) {
+    PollCostQueries(app);
+    for (;;) {
+        long int bestDistance = LONG_MAX;
+        int best = -1;
+
+        app->pendingTiles = 0;
+        for (int x = RESERVED_TEXTURES; x < app->usedTextures; x++) {
+            GeneratedImage *image = &app->images[x];
+            long int distance = tileDistance(app, x);
+            if (distance < 0) {
+                if (image->state == TILE_PENDING) {
+                    image->state = TILE_IDLE;
+                    app->costModel.cancelled++;
+                }
+                continue;
+            }
+            if (image->state == TILE_IDLE && !image->ready) image->state = TILE_PENDING;
+            if (image->state != TILE_PENDING) continue;
+            app->pendingTiles++;
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = x;
+            }
+        }
+        if (best < 0) return;
+
+        //With the compile queue full, submitting another job would block until the ones in it are rendered, whatever the deadline; FinishCompileJobs makes room within the budget instead
+        if (app->compileQueue.inFlight >= COMPILE_QUEUE_SIZE) {
+            app->costModel.deferred++;
+            return;
+        }
+
+        GeneratedImage *image = &app->images[best];
+        if (!image->eR) ChooseExpression(app, best);
+        if (app->frameWork && SDL_GetPerformanceCounter() + PredictCost(app, image) > deadline) {
+            app->costModel.deferred++;
+            return;
+        }
+        app->frameWork++;
+        GenerateImage(app, best);
+    }
+}
+
+static void Animate(APP *app) {
+    if (fabs(app->scrollVelocity) > SCROLL_STOP_THRESHOLD) {
+        DamageAll(app); //Everything on screen moves
+        //Scroll the screen
+        app->scrollMinor += app->scrollVelocity;
+        app->scrollVelocity *= 0.97f;
+        //Once you've scrolled enough, take away from scrollMinor and add/subtract from/to scrollMajor
+        if (app->scrollMinor > SCROLL_PER_ROW && app->scrollMajor < ULONG_MAX - (unsigned long int)rowsPerScreen(app)) {
+            app->scrollMajor++;
+            app->scrollMinor -= SCROLL_PER_ROW;
+
+            //TODO: Cycle off the oldest expressions/textures and generate a row of new ones (if they haven't already been generated)
+            //TODO: This little while loop will generate based on the number of used textures, so it's not for the final product. It's just for testing up to MAX_TEXTURES-RESERVED_TEXTURES images.
+            //It only adds the tiles; ScheduleGeneration draws them as the frame budget allows.
+            while (app->usedTextures < MAX_TEXTURES && app->usedTextures < IMAGES_PER_ROW * (app->scrollMajor + rowsPerScreen(app) + 1) + RESERVED_TEXTURES) GenerateNewImage(app);
+        }
+        else if (app->scrollMinor < 0 && app->scrollMajor > 0) {
+            app->scrollMajor--;
+            app->scrollMinor += SCROLL_PER_ROW;
+
+            //TODO: Cycle off the newest expressions/textures and reload a row of old ones
+        }
+    }
+    //Prevent scrolling above the top (smoothly!) or below the bottom (assuming it were possible to reach the bottom)
+    if (app->scrollMajor == 0 && app->scrollMinor < -SCROLL_STOP_THRESHOLD) {
+        app->scrollVelocity *= 0.9f;
+        app->scrollMinor *= 0.9f;
+        DamageAll(app); //Everything on screen moves
+    } else if (app->scrollMajor == ULONG_MAX - (unsigned long int)rowsPerScreen(app) && app->scrollMinor > SCROLL_PER_ROW + SCROLL_STOP_THRESHOLD) {
+        app->scrollVelocity *= 0.9f;
+        app->scrollMinor = SCROLL_PER_ROW + (app->scrollMinor - SCROLL_PER_ROW) * 0.9f;
+        DamageAll(app); //Everything on screen moves
+    }
+}
+
+
+
+/*****************************************************************************
+ *                             Inspector Functions                           *
+ *****************************************************************************/
+
+//Zoom level for the inspector's current scale: the shallowest one whose tiles are drawn no bigger than twice INSPECTOR_TILE_SIZE
+static int InspectorLevel(APP *app) {
+    int level = 0;
+    while (level < INSPECTOR_MAX_LEVEL && app->inspector.scale / (1 << level) > 2 * INSPECTOR_TILE_SIZE) level++;
+    return level;
+}
+
+//Find the columns and rows (range[0] to range[2] and range[1] to range[3], inclusive) of the tiles at a zoom level that are at least partly in the window. Returns FALSE if the image is entirely off-screen.
+static int InspectorVisibleTiles(APP *app, int level, int range[4]) {
+    Inspector *inspector = &app->inspector;
+    double tileSize = inspector->scale / (1 << level), last = (1 << level) - 1;
+    double x0 = floor(-inspector->x / tileSize), x1 = floor((app->width - inspector->x) / tileSize);
+    double y0 = floor(-inspector->y / tileSize), y1 = floor((app->height - inspector->y) / tileSize);
+
+    if (x0 < 0.0) x0 = 0.0;
+    if (y0 < 0.0) y0 = 0.0;
+    if (x1 > last) x1 = last;
+    if (y1 > last) y1 = last;
+    if (x0 > x1 || y0 > y1) return FALSE;
+    range[0] = (int)x0; range[1] = (int)y0;
+    range[2] = (int)x1; range[3] = (int)y1;
+    return TRUE;
+}
+
+//Find a cached tile of the inspected image, or return NULL
+static InspectorTile *InspectorTileFind(Inspector *inspector, int level, int column, int row) {
+    for (int x = 0; x < INSPECTOR_TILES; x++) {
+        InspectorTile *tile = &inspector->tiles[x];
+        if (tile->length == inspector->length && tile->level == level && tile->column == column && tile->row == row && !memcmp(tile->expression, inspector->expression, inspector->length)) {
+            tile->lastUsed = inspector->clock;
+            return tile;
+        }
+    }
+    return NULL;
+}
+
+//Whether the inspector's program has linked, without blocking if the driver compiles in parallel
+static int InspectorProgramReady(APP *app) {
+    CompileJob *job = &app->inspector.job;
+    GLint done = GL_TRUE;
+
+    if (job->state == JOB_COMPILING) {
+        if (app->compileQueue.parallelCompile) glGetProgramiv(job->program, GL_COMPLETION_STATUS_KHR, &done);
+        if (done) job->state = CheckProgram(job) ? JOB_FAILED : JOB_LINKED;
+    }
+    return job->state == JOB_LINKED;
+}
+
+//Render one tile of the inspected image, replacing the least recently used cached tile that the current frame doesn't need. Returns FALSE if it needs them all.
+static int RenderInspectorTile(APP *app, int level, int column, int row) {
+    Inspector *inspector = &app->inspector;
+    InspectorTile *tile = &inspector->tiles[0];
+    GLuint program = inspector->job.program;
+    float vector[2] = {0.0f, 0.0f};
+    float matrix[16];
+    float constants[MAX_CONSTANTS];
+
+    for (int x = 1; x < INSPECTOR_TILES; x++) {
+        if (inspector->tiles[x].lastUsed < tile->lastUsed) tile = &inspector->tiles[x];
+    }
+    if (tile->lastUsed == inspector->clock) return FALSE;
+
+    if (!tile->tex) {
+        glGenTextures(1, &tile->tex);
+        glBindTexture(GL_TEXTURE_2D, tile->tex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR); //Tiles are drawn at 1 to 2 times their size
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, INSPECTOR_TILE_SIZE, INSPECTOR_TILE_SIZE, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    }
+    memcpy(tile->expression, inspector->expression, inspector->length);
+    tile->length = inspector->length;
+    tile->level = level;
+    tile->column = column;
+    tile->row = row;
+    tile->lastUsed = inspector->clock;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, app->rttFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, tile->tex, 0);
+    glViewport(0, 0, INSPECTOR_TILE_SIZE, INSPECTOR_TILE_SIZE);
+
+    memset(matrix, 0, sizeof matrix);
+    matrix[0] = 2.0f / INSPECTOR_TILE_SIZE;
+    matrix[5] = 2.0f / INSPECTOR_TILE_SIZE;
+	matrix[12] = -1;
+	matrix[13] = -1;
+    matrix[15] = 1;
+
+    //Fill the tile with its part of the input image, filtered
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, matrix);
+    glUniform2fv(glGetUniformLocation(program, "translation"), 1, vector);
+    glUniform1f(glGetUniformLocation(program, "size"), (float)INSPECTOR_TILE_SIZE);
+    glUniform1f(glGetUniformLocation(program, "uvLevel"), (float)level);
+    vector[0] = (float)column;
+    vector[1] = (float)row;
+    glUniform2fv(glGetUniformLocation(program, "uvTile"), 1, vector);
+    glUniform3fv(glGetUniformLocation(program, "normalizeMult"), 1, inspector->normalizeMult);
+    glUniform3fv(glGetUniformLocation(program, "normalizeAdd"), 1, inspector->normalizeAdd);
+    ExpressionConstants(inspector->expression, inspector->length, constants);
+    glUniform1fv(glGetUniformLocation(program, "constants"), MAX_CONSTANTS, constants);
+
+    glBindTexture(GL_TEXTURE_2D, app->textures[0]);
+    glBindVertexArray(app->VAO);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    inspector->rendered++;
+
+    glUseProgram(app->program);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, app->width, app->height);
+    return TRUE;
+}
+
+//Render the tiles of the inspected image that are visible at the current zoom level but not cached, nearest the middle of the window first, for as long as their predicted cost fits before deadline (in performance counter ticks). If nothing has been rendered yet this frame, one is rendered anyway.
+static void InspectorRenderTiles(APP *app, uint64_t deadline) {
+    Inspector *inspector = &app->inspector;
+    int level = InspectorLevel(app), range[4];
+    double tileSize = inspector->scale / (1 << level);
+
+    inspector->missing = 0;
+    if (inspector->textureIdx < 0) return;
+    if (!InspectorProgramReady(app)) {
+        inspector->missing = inspector->job.state == JOB_COMPILING; //Keep polling until it's done
+        return;
+    }
+    inspector->clock++;
+    if (!InspectorVisibleTiles(app, level, range)) return;
+
+    //The cost model is calibrated on images at the input's size
+    double cost = ExpressionCostUnits(app, inspector->expression, inspector->length, 0) * app->costModel.ticksPerUnit
+        * INSPECTOR_TILE_SIZE * INSPECTOR_TILE_SIZE / ((double)app->inputImageSize * app->inputImageSize);
+
+    for (;;) {
+        double bestDistance = HUGE_VAL;
+        int bestColumn = 0, bestRow = 0;
+
+        inspector->missing = 0;
+        for (int row = range[1]; row <= range[3]; row++) {
+            for (int column = range[0]; column <= range[2]; column++) {
+                if (InspectorTileFind(inspector, level, column, row)) continue;
+                double dx = inspector->x + (column + 0.5) * tileSize - app->width / 2.0;
+                double dy = inspector->y + (row + 0.5) * tileSize - app->height / 2.0;
+                inspector->missing++;
+                if (dx * dx + dy * dy < bestDistance) {
+                    bestDistance = dx * dx + dy * dy;
+                    bestColumn = column;
+                    bestRow = row;
+                }
+            }
+        }
+        if (!inspector->missing) return;
+        if (app->frameWork && SDL_GetPerformanceCounter() + cost > deadline) return;
+        app->frameWork++;
+        if (!RenderInspectorTile(app, level, bestColumn, bestRow)) return;
+        DamageAll(app);
+    }
+}
+
+//Draw the inspected image's tiles at the current zoom level. Any that aren't rendered yet are drawn from the part of the nearest coarser tile that covers them, magnified.
+static void DrawInspector(APP *app) {
+    Inspector *inspector = &app->inspector;
+    int level = InspectorLevel(app), range[4];
+    double tileSize = inspector->scale / (1 << level);
+    float vector[2];
+
+    if (!InspectorVisibleTiles(app, level, range)) return;
+    glBindVertexArray(app->VAO);
+    glUniform1f(app->attrib_size, (float)tileSize);
+    for (int row = range[1]; row <= range[3]; row++) {
+        for (int column = range[0]; column <= range[2]; column++) {
+            for (int up = 0; up <= level; up++) {
+                InspectorTile *tile = InspectorTileFind(inspector, level - up, column >> up, row >> up);
+                if (!tile) continue;
+
+                glUniform1f(app->attrib_uvLevel, (float)up);
+                vector[0] = (float)(column & ((1 << up) - 1));
+                vector[1] = (float)(row & ((1 << up) - 1));
+                glUniform2fv(app->attrib_uvTile, 1, vector);
+                vector[0] = (float)(inspector->x + column * tileSize);
+                vector[1] = (float)(inspector->y + row * tileSize);
+                glUniform2fv(app->attrib_translation, 1, vector);
+                glBindTexture(GL_TEXTURE_2D, tile->tex);
+                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                break;
+            }
+        }
+    }
+
+    //Put back what the grid draws with
+    vector[0] = 0.0f;
+    vector[1] = 0.0f;
+    glUniform1f(app->attrib_uvLevel, 0.0f);
+    glUniform2fv(app->attrib_uvTile, 1, vector);
+    glUniform1f(app->attrib_size, (float)app->inputImageSize);
+}
+
+//Move the inspected image by the given number of pixels (SDL directions, so y is down), but not so far that it stops covering the middle of the window
+static void InspectorPan(APP *app, int dx, int dy) {
+    Inspector *inspector = &app->inspector;
+    double middleX = app->width / 2.0, middleY = app->height / 2.0;
+
+    inspector->x += dx;
+    inspector->y -= dy;
+    if (inspector->x > middleX) inspector->x = middleX;
+    if (inspector->x + inspector->scale < middleX) inspector->x = middleX - inspector->scale;
+    if (inspector->y > middleY) inspector->y = middleY;
+    if (inspector->y + inspector->scale < middleY) inspector->y = middleY - inspector->scale;
+    DamageAll(app);
+}
+
+//Zoom the inspector in by a factor (or out, if it's less than 1), keeping the point at the given cursor position (SDL coordinates) where it is. The image is kept between a quarter of the window and INSPECTOR_MAX_MAGNIFICATION times its size.
+static void InspectorZoom(APP *app, double factor, int cursorX, int cursorY) {
+    Inspector *inspector = &app->inspector;
+    double x = cursorX, y = app->height - cursorY;
+    double scale = inspector->scale * factor;
+
+    if (scale < (app->width < app->height ? app->width : app->height) / 4.0) scale = (app->width < app->height ? app->width : app->height) / 4.0;
+    if (scale > app->inputImageSize * INSPECTOR_MAX_MAGNIFICATION) scale = app->inputImageSize * INSPECTOR_MAX_MAGNIFICATION;
+    factor = scale / inspector->scale;
+    inspector->x = x - (x - inspector->x) * factor;
+    inspector->y = y - (y - inspector->y) * factor;
+    inspector->scale = scale;
+    InspectorPan(app, 0, 0);
+}
+
+//Open the inspector on an image that has been drawn, fit to the window
+static void OpenInspector(APP *app, int textureIdx) {
+    Inspector *inspector = &app->inspector;
+    GeneratedImage *image = &app->images[textureIdx];
+
+    inspector->textureIdx = textureIdx;
+    memcpy(inspector->expression, image->eR, image->lengthR);
+    inspector->length = image->lengthR;
+    memcpy(inspector->normalizeMult, image->normalizeMult, sizeof inspector->normalizeMult);
+    memcpy(inspector->normalizeAdd, image->normalizeAdd, sizeof inspector->normalizeAdd);
+    inspector->scale = app->width < app->height ? app->width : app->height;
+    inspector->x = (app->width - inspector->scale) / 2.0;
+    inspector->y = (app->height - inspector->scale) / 2.0;
+    app->scrollVelocity = 0.0f; //The grid stays where it was
+
+    //It gets its own program, since the cached one may read from the prefix cache, which only has the input's resolution, and could be deleted while the inspector is open
+    inspector->job.source = expressionToGLSLString(inspector->expression, inspector->length, 0);
+    CompileProgram(app, &inspector->job);
+    inspector->job.state = JOB_COMPILING;
+    inspector->missing = 1;
+    DamageAll(app);
+}
+
+//Close the inspector and go back to the grid. Its tiles stay cached in case the same image is opened again.
+static void CloseInspector(APP *app) {
+    Inspector *inspector = &app->inspector;
+
+    DeleteCompiledProgram(app, &inspector->job);
+    inspector->job.state = JOB_FREE;
+    inspector->textureIdx = -1;
+    inspector->missing = 0;
+    DamageAll(app);
+}
+
+
+
+/*****************************************************************************
+ *                            Rendering Functions                            *
+ *****************************************************************************/
+
+
+//Draw a scene to OpenGL
+static void Render(APP *app) {
+	float vector[2];
+    int x0 = 0, y0 = 0, x1 = app->width, y1 = app->height; //Region being redrawn
+
+    //Draw into the composite texture, which still holds the previous frame, so anything outside the damaged region can be left alone
+    glBindFramebuffer(GL_FRAMEBUFFER, app->compositeFramebuffer);
+    if (!app->damageFull) {
+        x0 = app->damageX0; y0 = app->damageY0;
+        x1 = app->damageX1; y1 = app->damageY1;
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(x0, y0, x1 - x0, y1 - y0);
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    //Highlight the image under the cursor by clearing a slightly larger rectangle behind it in a different color
+    if (app->inspector.textureIdx < 0 && app->hoverTile >= RESERVED_TEXTURES && app->hoverTile < app->usedTextures) {
+        tilePosition(app, app->hoverTile, vector);
+        int hx0 = (int)floorf(vector[0]) - HOVER_BORDER, hy0 = (int)floorf(vector[1]) - HOVER_BORDER;
+        int hx1 = hx0 + app->inputImageSize + 2 * HOVER_BORDER + 1, hy1 = hy0 + app->inputImageSize + 2 * HOVER_BORDER + 1;
+        if (hx0 < x0) hx0 = x0;
+        if (hy0 < y0) hy0 = y0;
+        if (hx1 > x1) hx1 = x1;
+        if (hy1 > y1) hy1 = y1;
+        if (hx0 < hx1 && hy0 < hy1) {
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(hx0, hy0, hx1 - hx0, hy1 - hy0);
+            glClearColor(0.9f, 0.8f, 0.2f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            if (app->damageFull) glDisable(GL_SCISSOR_TEST);
+            else glScissor(x0, y0, x1 - x0, y1 - y0);
+        }
+    }
+
+    //Draw the filtered textures, after rendering the filtered base image to textures
+    //TODO: Make this a circular array buffer (along with one for the expressions). Save to disk when generated; unload a row when nearing capacity. Only reload when nearing necessity, though.
+    for (int x = RESERVED_TEXTURES; x < app->usedTextures && app->inspector.textureIdx < 0; x++) {
+        //Now draw the test texture (render-to-texture)
+        if (!app->images[x].ready) continue; //Still compiling
+        tilePosition(app, x, vector);
+
+        if (vector[1] < -SCROLL_PER_ROW || vector[1] > app->height) continue; //Don't draw off-screen!
+        if (vector[0] >= x1 || vector[0] + app->inputImageSize <= x0 || vector[1] >= y1 || vector[1] + app->inputImageSize <= y0) continue; //Don't draw outside the damaged region, either
+
+        glBindTexture(GL_TEXTURE_2D, app->textures[x]);
         glUniform1f(app->attrib_texture, app->textures[x]);
 
         glUniform2fv(app->attrib_translation, 1, vector);
@@ -867,7 +3280,1262 @@ static void Render(APP *app) {
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     }
 
-    SDL_GL_SwapWindow(app->window);
+    //The inspector covers the whole window instead
+    if (app->inspector.textureIdx >= 0) DrawInspector(app);
+    glDisable(GL_SCISSOR_TEST);
+
+    //The back buffer's contents are undefined after a swap, so copy the whole composite over every time; that's one blit rather than a redraw of every image
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, app->compositeFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, app->width, app->height, 0, 0, app->width, app->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    SDL_GL_SwapWindow(app->window);
+
+    app->updated = FALSE;
+    app->damageFull = FALSE;
+}
+
+
+
+/*****************************************************************************
+ *                              Server Functions                             *
+ *****************************************************************************/
+
+//Parse an expression given as hex bytecode (e.g. "102000" for red + 0.1) or as "seed:N", which generates the same expression GenerateNewImage would after srand(N). Returns its length, or 0 if it isn't a valid ccOcO... expression.
+static int ParseExpression(const char *text, unsigned char *expression) {
+    int length = 0;
+    unsigned int byte;
+
+    if (!strncmp(text, "seed:", 5)) {
+        srand((unsigned int)strtoul(text + 5, NULL, 10));
+        return RandomExpression(expression);
+    }
+
+    for (; text[0] && text[1]; text += 2) {
+        if (length >= MAX_EXPRESSION_LENGTH || sscanf(text, "%2x", &byte) != 1) return 0;
+        expression[length++] = (unsigned char)byte;
+    }
+    if (*text || !(length & 1)) return 0; //Odd number of hex digits, or an expression that ends with an operand
+
+    //The first byte must be a channel, then every odd byte a channel or constant, and every even byte an operator
+    if (expression[0] < 0x10 || expression[0] > 0x12) return 0;
+    for (int x = 1; x < length; x++) {
+        if (x & 1) {
+            if ((expression[x] < 0x10 || expression[x] > 0x12) && (expression[x] < 0x20 || expression[x] > 0x2F)) return 0;
+        } else if (expression[x] > 0x7) return 0;
+    }
+    return length;
+}
+
+//Find the requested input among the resident ones, loading it over an unused or the least recently used one if necessary. Returns NULL if it can't be loaded.
+static ServerInput* ServerGetInput(Server *server, const char *name) {
+    ServerInput *input = NULL;
+
+    //Only serve files from the working directory
+    for (const char *c = name; ; c = strchr(c, ',') + 1) {
+        if (!*c || *c == '.' || *c == ',') return NULL;
+        if (!strchr(c, ',')) break;
+    }
+    if (strpbrk(name, "/\\:")) return NULL;
+
+    for (int x = 0; x < SERVER_MAX_INPUTS; x++) {
+        ServerInput *candidate = &server->inputs[x];
+        if (!strcmp(candidate->name, name)) {
+            candidate->lastUsed = server->batches;
+            return candidate;
+        }
+
+        //Don't evict an input that a request in the current batch still needs
+        int pending = 0;
+        for (int y = 0; y < server->requestCount; y++) pending |= server->requests[y].input == candidate;
+        if (pending) continue;
+        if (!input || (input->name[0] && (!candidate->name[0] || candidate->lastUsed < input->lastUsed))) input = candidate;
+    }
+    if (!input) return NULL;
+
+    input->name[0] = 0;
+    if (!(input->size = LoadInputArray(input->tex, name, &input->layers, input->rangeMin, input->rangeMax))) return NULL;
+    strcpy(input->name, name);
+    input->lastUsed = server->batches;
+    return input;
+}
+
+//Send a whole buffer, since send() may not. Returns 0 on success.
+static int SendAll(SOCKET socket, const void *data, int length) {
+    const char *bytes = (const char*)data;
+    while (length > 0) {
+        int sent = send(socket, bytes, length, MSG_NOSIGNAL);
+        if (sent <= 0) return 1;
+        bytes += sent;
+        length -= sent;
+    }
+    return 0;
+}
+
+//Disconnect a client and discard anything it sent
+static void ServerDropClient(Server *server, int client) {
+    if (client < 0 || server->clients[client].socket == INVALID_SOCKET) return;
+    closesocket(server->clients[client].socket);
+    server->clients[client].socket = INVALID_SOCKET;
+    server->clients[client].length = 0;
+
+    //Its pending requests still get rendered with the batch, but nobody gets the responses (in particular not a new client in the same slot)
+    for (int x = 0; x < server->requestCount; x++) {
+        if (server->requests[x].client == client) server->requests[x].client = -1;
+    }
+}
+
+//Respond to a request that couldn't be rendered
+static void ServerError(Server *server, int client, const char *message) {
+    char line[SERVER_REQUEST_MAX];
+    if (client < 0) return;
+    snprintf(line, sizeof line, "ERROR %s\n", message);
+    if (SendAll(server->clients[client].socket, line, strlen(line))) ServerDropClient(server, client);
+}
+
+//Parse the first complete request line in a client's buffer, if it has one and nothing of its is already waiting in the batch (so its responses stay in order)
+static void ServerTakeRequest(Server *server, int client) {
+    ServerClient *c = &server->clients[client];
+    char line[SERVER_REQUEST_MAX];
+    char *end, *command, *name, *expressionText, *option;
+
+    if (c->socket == INVALID_SOCKET || server->requestCount >= SERVER_BATCH_SIZE) return;
+    for (int x = 0; x < server->requestCount; x++) {
+        if (server->requests[x].client == client) return;
+    }
+    if (!(end = memchr(c->buffer, '\n', c->length))) return;
+
+    //Take the line out of the buffer
+    int lineLength = end - c->buffer;
+    memcpy(line, c->buffer, lineLength);
+    line[lineLength] = 0;
+    if (lineLength && line[lineLength - 1] == '\r') line[lineLength - 1] = 0;
+    c->length -= lineLength + 1;
+    memmove(c->buffer, end + 1, c->length);
+
+    //<RENDER|NORMALIZE> <input image[,input image...]> <hex bytecode|seed:N> [joint]
+    ServerRequest *request = &server->requests[server->requestCount];
+    memset(request, 0, sizeof *request);
+    request->client = client;
+    command = strtok(line, " ");
+    name = strtok(NULL, " ");
+    expressionText = strtok(NULL, " ");
+    option = strtok(NULL, " ");
+    if (!expressionText) {
+        ServerError(server, client, "Expected: RENDER|NORMALIZE <input image[,input image...]> <hex bytecode|seed:N> [joint]");
+        return;
+    }
+    if (option && !strcmp(option, "joint")) request->joint = TRUE;
+    if (!strcmp(command, "RENDER")) request->render = TRUE;
+    else if (strcmp(command, "NORMALIZE")) {
+        ServerError(server, client, "Unknown command");
+        return;
+    }
+    if (!(request->expressionLength = ParseExpression(expressionText, request->expression))) {
+        ServerError(server, client, "Invalid expression");
+        return;
+    }
+    if (!(request->input = ServerGetInput(server, name))) {
+        ServerError(server, client, "Could not load input image (or too many different inputs at once)");
+        return;
+    }
+    server->requestCount++;
+}
+
+//Accept new connections and read whatever clients have sent, waiting up to timeout milliseconds for something to happen, then parse complete requests
+static void ServerPoll(Server *server, int timeout) {
+    struct timeval tv = {0, timeout * 1000};
+    fd_set readable;
+    SOCKET highest = server->listener;
+
+    FD_ZERO(&readable);
+    FD_SET(server->listener, &readable);
+    for (int x = 0; x < SERVER_MAX_CLIENTS; x++) {
+        if (server->clients[x].socket == INVALID_SOCKET) continue;
+        if (server->clients[x].length == sizeof server->clients[x].buffer) continue; //No room until its queued requests are handled
+        FD_SET(server->clients[x].socket, &readable);
+        if (server->clients[x].socket > highest) highest = server->clients[x].socket;
+    }
+
+    if (select(highest + 1, &readable, NULL, NULL, &tv) > 0) {
+        if (FD_ISSET(server->listener, &readable)) {
+            SOCKET socket = accept(server->listener, NULL, NULL);
+            int x;
+            for (x = 0; x < SERVER_MAX_CLIENTS && server->clients[x].socket != INVALID_SOCKET; x++);
+            if (x < SERVER_MAX_CLIENTS) server->clients[x].socket = socket;
+            else if (socket != INVALID_SOCKET) closesocket(socket); //Too many clients
+        }
+
+        for (int x = 0; x < SERVER_MAX_CLIENTS; x++) {
+            ServerClient *c = &server->clients[x];
+            if (c->socket == INVALID_SOCKET || !FD_ISSET(c->socket, &readable)) continue;
+
+            int received = recv(c->socket, c->buffer + c->length, sizeof c->buffer - c->length, 0);
+            if (received <= 0) ServerDropClient(server, x); //Disconnected
+            else {
+                c->length += received;
+                if (c->length == sizeof c->buffer && !memchr(c->buffer, '\n', c->length)) {
+                    ServerError(server, x, "Request too long");
+                    ServerDropClient(server, x);
+                }
+            }
+        }
+    }
+
+    //Check every client, since a previous read may have left more than one request in a buffer
+    for (int x = 0; x < SERVER_MAX_CLIENTS; x++) ServerTakeRequest(server, x);
+}
+
+//Find the range of each channel over every layer of an input
+static void InputRange(const ServerInput *input, float min[3], float max[3]) {
+    for (int c = 0; c < 3; c++) {
+        min[c] = input->rangeMin[0][c];
+        max[c] = input->rangeMax[0][c];
+        for (int layer = 1; layer < input->layers; layer++) {
+            if (input->rangeMin[layer][c] < min[c]) min[c] = input->rangeMin[layer][c];
+            if (input->rangeMax[layer][c] > max[c]) max[c] = input->rangeMax[layer][c];
+        }
+    }
+}
+
+//Fill in a NORMALIZE request's parameters from interval bounds alone, if they're exact for every layer. Returns TRUE if it did.
+static int ServerIntervalNormalize(ServerRequest *request) {
+    ServerInput *input = request->input;
+    float min[3], max[3], range[2];
+
+    for (int layer = 0; layer < input->layers; layer++) {
+        if (request->joint) InputRange(input, min, max);
+        else {
+            memcpy(min, input->rangeMin[layer], sizeof min);
+            memcpy(max, input->rangeMax[layer], sizeof max);
+        }
+        if (ExpressionInterval(request->expression, request->expressionLength, min, max, range) != INTERVAL_EXACT) return FALSE;
+        min[0] = range[0];
+        max[0] = range[1];
+        min[1] = max[1] = min[2] = max[2] = 1.0f; //Green and blue are constant for now; see expressionToGLSLString
+        RangeToNormalization(min, max, request->normalizeMult[layer], request->normalizeAdd[layer]);
+    }
+    return TRUE;
+}
+
+//Set the uniforms that layeredVertexShader and layeredFragmentShaderTemplate need to draw each layer as a square of the given size, in a grid that's columns wide starting at (x, 0), in a target of the given dimensions
+static void SetFilterUniforms(GLuint program, int targetWidth, int targetHeight, float x, float size, int columns, int layers, float normalizeMult[][3], float normalizeAdd[][3], const float constants[MAX_CONSTANTS]) {
+    float vector[2] = {x, 0.0f};
+    float matrix[16];
+
+    memset(matrix, 0, sizeof matrix);
+    matrix[0] = 2.0f / targetWidth;
+    matrix[5] = 2.0f / targetHeight;
+	matrix[12] = -1;
+	matrix[13] = -1;
+    matrix[15] = 1;
+
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, matrix);
+    glUniform2fv(glGetUniformLocation(program, "translation"), 1, vector);
+    glUniform1f(glGetUniformLocation(program, "size"), size);
+    glUniform1i(glGetUniformLocation(program, "columns"), columns);
+    glUniform3fv(glGetUniformLocation(program, "layerMult"), layers, &normalizeMult[0][0]);
+    glUniform3fv(glGetUniformLocation(program, "layerAdd"), layers, &normalizeAdd[0][0]);
+    glUniform1fv(glGetUniformLocation(program, "constants"), MAX_CONSTANTS, constants);
+}
+
+//Render requests that share an input (and whose programs are linked) together. Each request is one instanced draw covering every layer of the input: first its normalization samples, in a column of their own in one shared texture, so there's one readback for the whole batch, then (for RENDER) the full-size images in a grid.
+static void ServerRenderBatch(APP *app, Server *server, ServerRequest **batch, int count) {
+    float identityMult[MAX_LAYERS][3];
+    float identityAdd[MAX_LAYERS][3];
+    ServerInput *input = batch[0]->input;
+    int size = input->size, layers = input->layers;
+    int sampleWidth = count * NORMALIZATION_SAMPLE_SIZE, sampleHeight = layers * NORMALIZATION_SAMPLE_SIZE;
+    GLint maxSize;
+
+    for (int x = 0; x < layers; x++) {
+        identityMult[x][0] = identityMult[x][1] = identityMult[x][2] = 1.0f;
+        identityAdd[x][0] = identityAdd[x][1] = identityAdd[x][2] = 0.0f;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, app->rttFramebuffer);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, input->tex);
+    glBindVertexArray(app->VAO);
+
+    //Draw every sample, then read them all back at once
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, server->sampleTexture, 0);
+    glViewport(0, 0, sampleWidth, sampleHeight);
+    float constants[MAX_CONSTANTS];
+    int drawn = 0;
+    for (int x = 0; x < count; x++) {
+        if (batch[x]->intervalOnly) continue;
+        drawn++;
+        ExpressionConstants(batch[x]->expression, batch[x]->expressionLength, constants);
+        SetFilterUniforms(batch[x]->job.program, sampleWidth, sampleHeight, (float)(x * NORMALIZATION_SAMPLE_SIZE), (float)NORMALIZATION_SAMPLE_SIZE, 1, layers, identityMult, identityAdd, constants);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, layers);
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    if (drawn) glReadPixels(0, 0, sampleWidth, sampleHeight, GL_RGB, GL_FLOAT, &server->pixelBuffer[0]);
+    for (int x = 0; x < count; x++) {
+        ServerRequest *request = batch[x];
+        if (request->intervalOnly) continue;
+        const float *column = &server->pixelBuffer[x * NORMALIZATION_SAMPLE_SIZE * 3];
+        if (request->joint) {
+            //One set of parameters from every layer's sample, and the range of every layer
+            float inputMin[3], inputMax[3];
+            InputRange(input, inputMin, inputMax);
+            ExpressionNormalization(request->expression, request->expressionLength, inputMin, inputMax, column, sampleWidth * 3, sampleHeight, request->normalizeMult[0], request->normalizeAdd[0]);
+            for (int y = 1; y < layers; y++) {
+                memcpy(request->normalizeMult[y], request->normalizeMult[0], sizeof request->normalizeMult[0]);
+                memcpy(request->normalizeAdd[y], request->normalizeAdd[0], sizeof request->normalizeAdd[0]);
+            }
+        } else {
+            for (int y = 0; y < layers; y++) {
+                ExpressionNormalization(request->expression, request->expressionLength, input->rangeMin[y], input->rangeMax[y],
+                    column + y * NORMALIZATION_SAMPLE_SIZE * sampleWidth * 3, sampleWidth * 3, NORMALIZATION_SAMPLE_SIZE, request->normalizeMult[y], request->normalizeAdd[y]);
+            }
+        }
+    }
+
+    //Then draw the full-size images for RENDER requests, all layers at once in a grid that fits in a texture
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    int columns = maxSize / size < layers ? maxSize / size : layers;
+    if (columns < 1) columns = 1;
+    int rows = (layers + columns - 1) / columns;
+    if (columns * size != server->outputWidth || rows * size != server->outputHeight) {
+        glBindTexture(GL_TEXTURE_2D, server->outputTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, columns * size, rows * size, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+        server->outputWidth = columns * size;
+        server->outputHeight = rows * size;
+    }
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, server->outputTexture, 0);
+    glViewport(0, 0, server->outputWidth, server->outputHeight);
+    unsigned char *grid = NULL;
+    for (int x = 0; x < count; x++) {
+        ServerRequest *request = batch[x];
+        if (!request->render) continue;
+        if (!grid && !(grid = (unsigned char*)malloc((size_t)server->outputWidth * server->outputHeight * 3))) break;
+        if (!(request->pixels = (unsigned char*)malloc((size_t)layers * size * size * 3))) continue;
+
+        ExpressionConstants(request->expression, request->expressionLength, constants);
+        SetFilterUniforms(request->job.program, server->outputWidth, server->outputHeight, 0.0f, (float)size, columns, layers, request->normalizeMult, request->normalizeAdd, constants);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, layers);
+        glReadPixels(0, 0, server->outputWidth, server->outputHeight, GL_RGB, GL_UNSIGNED_BYTE, grid);
+
+        //Cut the grid up into one image per layer
+        for (int layer = 0; layer < layers; layer++) {
+            for (int y = 0; y < size; y++) {
+                memcpy(request->pixels + ((size_t)layer * size + y) * size * 3,
+                    grid + (((size_t)(layer / columns) * size + y) * server->outputWidth + (layer % columns) * size) * 3, size * 3);
+            }
+        }
+    }
+    free(grid);
+
+    glUseProgram(app->program);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, app->width, app->height);
+}
+
+//Compile, render, and respond to every request in the batch, grouped by input
+static void ServerRenderRequests(APP *app, Server *server) {
+    ServerRequest *batch[SERVER_BATCH_SIZE];
+    char line[MAX_LAYERS * 6 * 16 + 16];
+
+    //Submit every program that isn't cached (or needed at all) before checking any of them, so the driver can compile them in parallel if it supports that
+    unsigned char skeleton[MAX_EXPRESSION_LENGTH];
+    for (int x = 0; x < server->requestCount; x++) {
+        ServerRequest *request = &server->requests[x];
+        request->job.layered = TRUE;
+        if (!request->render && (request->intervalOnly = ServerIntervalNormalize(request))) continue;
+        ExpressionSkeleton(request->expression, request->expressionLength, 0, skeleton);
+        CachedProgram *cached = ProgramCacheFind(&app->programCache, skeleton, request->expressionLength, TRUE);
+        if (cached) {
+            request->job.program = cached->job.program;
+            request->cached = TRUE;
+            continue;
+        }
+        request->job.source = expressionToGLSLString(request->expression, request->expressionLength, 0);
+        CompileProgram(app, &request->job);
+    }
+
+    for (int x = 0; x < server->requestCount; x++) {
+        int count = 0;
+        if (!server->requests[x].input) continue; //Already handled with an earlier group
+
+        //Gather everything that targets the same input
+        for (int y = x; y < server->requestCount; y++) {
+            ServerRequest *request = &server->requests[y];
+            if (request->input != server->requests[x].input) continue;
+            if (!request->cached && !request->intervalOnly && CheckProgram(&request->job)) ServerError(server, request->client, "Could not compile expression");
+            else {
+                request->job.state = JOB_LINKED;
+                batch[count++] = request;
+            }
+        }
+        if (count) ServerRenderBatch(app, server, batch, count);
+
+        for (int y = 0; y < count; y++) {
+            ServerRequest *request = batch[y];
+            if (request->client < 0) continue; //Disconnected in the meantime
+            SOCKET socket = server->clients[request->client].socket;
+            int size = request->input->size, layers = request->input->layers;
+            if (request->render) {
+                //Followed by RGB bytes for each layer, bottom row first, as OpenGL stores them
+                if (layers == 1) snprintf(line, sizeof line, "IMAGE %d %d\n", size, size);
+                else snprintf(line, sizeof line, "IMAGES %d %d %d\n", layers, size, size);
+                if (!request->pixels) ServerError(server, request->client, "Out of memory");
+                else if (SendAll(socket, line, strlen(line)) || SendAll(socket, request->pixels, layers * size * size * 3))
+                    ServerDropClient(server, request->client);
+            } else {
+                //Six numbers per layer
+                int length = snprintf(line, sizeof line, "NORMALIZE");
+                for (int layer = 0; layer < layers; layer++) {
+                    length += snprintf(line + length, sizeof line - length, " %g %g %g %g %g %g",
+                        request->normalizeMult[layer][0], request->normalizeMult[layer][1], request->normalizeMult[layer][2],
+                        request->normalizeAdd[layer][0], request->normalizeAdd[layer][1], request->normalizeAdd[layer][2]);
+                }
+                snprintf(line + length, sizeof line - length, "\n");
+                if (SendAll(socket, line, strlen(line))) ServerDropClient(server, request->client);
+            }
+        }
+
+        //Mark the group as handled
+        ServerInput *input = server->requests[x].input;
+        for (int y = x; y < server->requestCount; y++) {
+            if (server->requests[y].input == input) server->requests[y].input = NULL;
+        }
+    }
+
+    //Keep the new programs; the cache isn't touched until now so nothing a batch uses can be evicted while it's rendering
+    for (int x = 0; x < server->requestCount; x++) {
+        ServerRequest *request = &server->requests[x];
+        if (!request->cached && !request->intervalOnly && (request->job.state != JOB_LINKED || ProgramCacheAdd(app, &request->job, request->expression, request->expressionLength, 0)))
+            DeleteCompiledProgram(app, &request->job);
+        free(request->pixels);
+    }
+    server->requestCount = 0;
+    server->batches++;
+}
+
+//Run as a headless rendering service on localhost until the process is told to quit
+static int ServerLoop(APP *app, int port) {
+    static Server server; //Too big for the stack
+    struct sockaddr_in address;
+    int one = 1, quit = 0;
+    SDL_Event evt;
+
+    memset(&server, 0, sizeof server);
+    server.listener = INVALID_SOCKET;
+    for (int x = 0; x < SERVER_MAX_CLIENTS; x++) server.clients[x].socket = INVALID_SOCKET;
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa)) {
+        fprintf(stderr, "Could not initialize Winsock.\r\n");
+        return 1;
+    }
+#endif
+
+    //Only listen on the loopback interface; this isn't meant to be reachable from other machines
+    memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((unsigned short)port);
+    server.listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (server.listener == INVALID_SOCKET) goto catch;
+    setsockopt(server.listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof one);
+    if (bind(server.listener, (struct sockaddr*)&address, sizeof address) || listen(server.listener, SERVER_MAX_CLIENTS)) goto catch;
+
+    //Textures that stay resident between requests
+    glGenTextures(1, &server.sampleTexture);
+    glBindTexture(GL_TEXTURE_2D, server.sampleTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, SERVER_BATCH_SIZE * NORMALIZATION_SAMPLE_SIZE, MAX_LAYERS * NORMALIZATION_SAMPLE_SIZE, 0, GL_RGB, GL_FLOAT, 0);
+    glGenTextures(1, &server.outputTexture);
+    glBindTexture(GL_TEXTURE_2D, server.outputTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    for (int x = 0; x < SERVER_MAX_INPUTS; x++) glGenTextures(1, &server.inputs[x].tex);
+
+    fprintf(stderr, "Listening on 127.0.0.1:%d\r\n", port);
+    while (!quit) {
+        while (SDL_PollEvent(&evt)) if (evt.type == SDL_QUIT) quit = 1; //SDL turns Ctrl+C into SDL_QUIT
+
+        ServerPoll(&server, 50);
+        if (!server.requestCount) continue;
+
+        //Give other clients a moment to get their requests in, so they can be rendered in the same batch
+        ServerPoll(&server, SERVER_COALESCE_MS);
+        ServerRenderRequests(app, &server);
+    }
+
+    for (int x = 0; x < SERVER_MAX_INPUTS; x++) glDeleteTextures(1, &server.inputs[x].tex);
+    glDeleteTextures(1, &server.sampleTexture);
+    glDeleteTextures(1, &server.outputTexture);
+    for (int x = 0; x < SERVER_MAX_CLIENTS; x++) {
+        if (server.clients[x].socket != INVALID_SOCKET) closesocket(server.clients[x].socket);
+    }
+    closesocket(server.listener);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+
+//Error handling
+catch:
+    fprintf(stderr, "Could not listen on 127.0.0.1:%d\r\n", port);
+    if (server.listener != INVALID_SOCKET) closesocket(server.listener);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 1;
+}
+
+//Connect to a running server, send it one request, and print the response or save the image it returns as a BMP. A stand-in for the other tools in the pipeline.
+static int RunClient(int port, const char *output, const char *request) {
+    struct sockaddr_in address;
+    SOCKET server = INVALID_SOCKET;
+    char line[SERVER_REQUEST_MAX];
+    char filename[SERVER_REQUEST_MAX];
+    unsigned char *pixels = NULL;
+    int length = 0, layers = 1, width, height;
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa)) return 1;
+#endif
+
+    memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((unsigned short)port);
+    server = socket(AF_INET, SOCK_STREAM, 0);
+    if (server == INVALID_SOCKET || connect(server, (struct sockaddr*)&address, sizeof address)) {
+        fprintf(stderr, "Could not connect to 127.0.0.1:%d\r\n", port);
+        goto catch;
+    }
+
+    snprintf(line, sizeof line, "%s\n", request);
+    if (SendAll(server, line, strlen(line))) goto catch;
+
+    //Read the response line one byte at a time, so nothing after it gets consumed
+    while (length < (int)sizeof line - 1 && recv(server, &line[length], 1, 0) == 1 && line[length] != '\n') length++;
+    line[length] = 0;
+    printf("%s\n", line);
+
+    if (sscanf(line, "IMAGE %d %d", &width, &height) == 2 || sscanf(line, "IMAGES %d %d %d", &layers, &width, &height) == 3) {
+        int size = width * height * 3;
+        if (!(pixels = (unsigned char*)malloc(size))) goto catch;
+        for (int layer = 0; layer < layers; layer++) {
+            for (length = 0; length < size; ) {
+                int received = recv(server, (char*)pixels + length, size - length, 0);
+                if (received <= 0) goto catch;
+                length += received;
+            }
+
+            //Flip it right side up, since the server sends the bottom row first
+            unsigned char *row = (unsigned char*)malloc(width * 3);
+            for (int y = 0; row && y < height / 2; y++) {
+                memcpy(row, pixels + y * width * 3, width * 3);
+                memcpy(pixels + y * width * 3, pixels + (height - 1 - y) * width * 3, width * 3);
+                memcpy(pixels + (height - 1 - y) * width * 3, row, width * 3);
+            }
+            free(row);
+
+            //With several images, number them: out.bmp becomes out-0.bmp, out-1.bmp...
+            const char *extension = strrchr(output, '.');
+            if (layers == 1) snprintf(filename, sizeof filename, "%s", output);
+            else if (extension) snprintf(filename, sizeof filename, "%.*s-%d%s", (int)(extension - output), output, layer, extension);
+            else snprintf(filename, sizeof filename, "%s-%d", output, layer);
+
+            SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(pixels, width, height, 24, width * 3, SDL_PIXELFORMAT_RGB24);
+            if (!surface || SDL_SaveBMP(surface, filename)) fprintf(stderr, "Could not save %s: %s\r\n", filename, SDL_GetError());
+            if (surface) SDL_FreeSurface(surface);
+        }
+    }
+
+    free(pixels);
+    closesocket(server);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return strncmp(line, "ERROR", 5) == 0;
+
+//Error handling
+catch:
+    free(pixels);
+    if (server != INVALID_SOCKET) closesocket(server);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 1;
+}
+
+
+
+/*****************************************************************************
+ *                           Enumeration Functions                           *
+ *****************************************************************************/
+
+//Convert a packed expression back into bytecode (which needs room for MAX_EXPRESSION_LENGTH bytes) and return its length
+static int UnpackExpression(uint64_t packed, unsigned char *expression) {
+    int operators = (int)(packed >> PACKED_COUNT_SHIFT);
+
+    expression[0] = 0x10 | (packed & 0x3);
+    for (int x = 0; x < operators; x++) {
+        int pair = (int)(packed >> (2 + 8 * x)) & 0xFF;
+        int operand = pair & 0x1F;
+        expression[1 + 2 * x] = operand < 3 ? 0x10 | operand : 0x20 | (operand - 3); //Channels come first, then constants
+        expression[2 + 2 * x] = pair >> 5;
+    }
+    return 1 + 2 * operators;
+}
+
+//Whether appending this operator and operand is the canonical way to write the result, as opposed to a reordering or a trivial variant of something else that gets enumerated anyway
+static inline int EnumIsCanonical(int channel, int operators, int previousPair, int operator, int operand) {
+    int group = operator < 2 ? 1 : operator < 4 ? 2 : 0; //+ and - commute with each other in a chain, as do * and /
+
+    //log and sin ignore their operand, so only one choice of it is needed
+    if ((operator == 5 || operator == 7) && operand != 0) return FALSE;
+
+    //The first operand can be swapped with the channel for + and *, so keep the order where the channel is lower
+    if (operators == 0 && operand < 3 && operand < channel && (operator == 0 || operator == 2)) return FALSE;
+
+    //In a run of + and - (or * and /), the steps can happen in any order, so only keep them sorted
+    if (previousPair >= 0 && group) {
+        int previousOperator = previousPair >> 5;
+        int previousGroup = previousOperator < 2 ? 1 : previousOperator < 4 ? 2 : 0;
+        if (group == previousGroup && ((operator << 5) | operand) < previousPair) return FALSE;
+    }
+    return TRUE;
+}
+
+//Whether an expression ending with this operator and operand only shifts or scales the expression before it, which normalization undoes
+static inline int EnumIsAffineTail(int operator, int operand) {
+    if (operand < 3) return FALSE; //A channel, not a constant
+    if (operator == 0 || operator == 1) return TRUE;
+    if (operator == 2 || operator == 3) return !(operator == 2 && operand == 3 + 8); //Except for * -0.1, which stands for all the ways to invert it
+    return FALSE;
+}
+
+//Whether an expression that is just the channel and this operator and operand isn't worth writing out: c+c normalizes to the same thing as c, and c-c, c/c and c%c are flat
+//Longer expressions that start with one are still enumerated, since the sorting in EnumIsCanonical can leave them as the only way to write things like 2r+g.
+static inline int EnumIsSelfPair(int channel, int operator, int operand) {
+    return operand == channel && (operator == 0 || operator == 1 || operator == 3 || operator == 6);
+}
+
+//Write out whatever the thread has buffered
+static void EnumFlush(EnumerationWorker *worker) {
+    if (worker->used && fwrite(worker->arena, sizeof *worker->arena, worker->used, worker->file) != (size_t)worker->used) worker->failed = TRUE;
+    worker->used = 0;
+}
+
+//Depth-first walk over everything that can be appended to a packed expression
+static void EnumStep(EnumerationWorker *worker, uint64_t packed, int operators, int previousPair) {
+    for (int operator = 0; operator < 8; operator++) {
+        for (int operand = 0; operand < ENUM_OPERANDS; operand++) {
+            if (!EnumIsCanonical((int)(packed & 0x3), operators, previousPair, operator, operand)) continue;
+            worker->visited++;
+
+            int pair = (operator << 5) | operand;
+            uint64_t next = (packed | ((uint64_t)pair << (2 + 8 * operators))) & ~((uint64_t)0x7 << PACKED_COUNT_SHIFT);
+            if (!EnumIsAffineTail(operator, operand)) {
+                worker->arena[worker->used++] = next | ((uint64_t)(operators + 1) << PACKED_COUNT_SHIFT);
+                worker->kept[operators + 1]++;
+                if (worker->used == ENUM_ARENA_SIZE) EnumFlush(worker);
+            }
+            if (operators + 1 < worker->enumeration->maxOperators) EnumStep(worker, next, operators + 1, pair);
+        }
+    }
+}
+
+//Worker thread body: take shards (each one a first channel, operator, and operand) until there are none left
+static int EnumWorker(void *data) {
+    EnumerationWorker *worker = (EnumerationWorker*)data;
+    int shard;
+
+    while ((shard = SDL_AtomicAdd(&worker->enumeration->nextShard, 1)) < ENUM_SHARDS && !worker->failed) {
+        int channel = shard / (8 * ENUM_OPERANDS), operator = shard / ENUM_OPERANDS % 8, operand = shard % ENUM_OPERANDS;
+        if (!EnumIsCanonical(channel, 0, -1, operator, operand)) continue;
+        worker->visited++;
+
+        int pair = (operator << 5) | operand;
+        uint64_t packed = (uint64_t)channel | ((uint64_t)pair << 2);
+        if (!EnumIsAffineTail(operator, operand) && !EnumIsSelfPair(channel, operator, operand)) {
+            worker->arena[worker->used++] = packed | ((uint64_t)1 << PACKED_COUNT_SHIFT);
+            worker->kept[1]++;
+            if (worker->used == ENUM_ARENA_SIZE) EnumFlush(worker);
+        }
+        if (worker->enumeration->maxOperators > 1) EnumStep(worker, packed, 1, pair);
+    }
+    EnumFlush(worker);
+    return 0;
+}
+
+//Enumerate every canonical expression with up to maxOperators operators across several threads, streaming them to disk as packed 64-bit values. Returns 0 on success.
+static int RunEnumeration(int maxOperators, const char *outputPrefix, int threads) {
+    Enumeration enumeration;
+    EnumerationWorker workers[ENUM_MAX_THREADS];
+    char filename[1024];
+    uint64_t visited = 0, kept[ENUM_MAX_OPERATORS + 1] = {0}, space = 0, level = 3;
+    int failed = 0;
+
+    if (maxOperators < 1 || maxOperators > ENUM_MAX_OPERATORS) {
+        fprintf(stderr, "Can only enumerate expressions with 1 to %d operators.\r\n", ENUM_MAX_OPERATORS);
+        return 1;
+    }
+    if (threads < 1) threads = SDL_GetCPUCount();
+    if (threads > ENUM_MAX_THREADS) threads = ENUM_MAX_THREADS;
+
+    enumeration.maxOperators = maxOperators;
+    enumeration.outputPrefix = outputPrefix;
+    SDL_AtomicSet(&enumeration.nextShard, 0);
+    memset(workers, 0, sizeof workers);
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    SDL_Thread *handles[ENUM_MAX_THREADS];
+    for (int x = 0; x < threads; x++) {
+        workers[x].enumeration = &enumeration;
+        workers[x].number = x;
+        snprintf(filename, sizeof filename, "%s.%d", outputPrefix, x);
+        workers[x].file = fopen(filename, "wb");
+        workers[x].arena = (uint64_t*)malloc(ENUM_ARENA_SIZE * sizeof (uint64_t));
+        handles[x] = NULL;
+        if (!workers[x].file || !workers[x].arena) {
+            fprintf(stderr, "Could not open %s.\r\n", filename);
+            failed = 1;
+            continue;
+        }
+        handles[x] = SDL_CreateThread(EnumWorker, "EnumWorker", &workers[x]);
+    }
+    for (int x = 0; x < threads; x++) {
+        if (handles[x]) SDL_WaitThread(handles[x], NULL);
+        else if (workers[x].file && workers[x].arena) EnumWorker(&workers[x]); //Couldn't make a thread, so finish up on this one
+        if (workers[x].file) fclose(workers[x].file);
+        free(workers[x].arena);
+        failed |= workers[x].failed;
+        visited += workers[x].visited;
+        for (int y = 1; y <= maxOperators; y++) kept[y] += workers[x].kept[y];
+    }
+    float seconds = (float)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    //Report how much the pruning saved, compared to every ccOcO... expression
+    printf("Operators  Unpruned             Kept\n");
+    for (int y = 1; y <= maxOperators; y++) {
+        level *= 8 * ENUM_OPERANDS;
+        space += level;
+        printf("%9d  %-19llu  %llu\n", y, (unsigned long long)level, (unsigned long long)kept[y]);
+    }
+    printf("Visited %llu of %llu expressions in %.2f s on %d threads\n", (unsigned long long)visited, (unsigned long long)space, seconds, threads);
+    if (failed) fprintf(stderr, "Some output could not be written.\r\n");
+    return failed;
+}
+
+//Print the packed expressions in a file written by RunEnumeration as hex bytecode, one per line, for ParseExpression (and the server) to consume
+static int RunUnpack(const char *filename) {
+    unsigned char expression[MAX_EXPRESSION_LENGTH];
+    uint64_t packed;
+    FILE *file = fopen(filename, "rb");
+
+    if (!file) {
+        fprintf(stderr, "Could not open %s.\r\n", filename);
+        return 1;
+    }
+    while (fread(&packed, sizeof packed, 1, file) == 1) {
+        PrintExpression(stdout, expression, UnpackExpression(packed, expression));
+        printf("\n");
+    }
+    fclose(file);
+    return 0;
+}
+
+//Evaluate an expression for one input pixel on the CPU, the way the GLSL that expressionToGLSLString writes for it does, in single precision like the GPU or in double. Also raises *magnitude to the largest finite value it passed through or used, which is the scale of any rounding error in the result, and sets *sensitive if a % came close enough to a multiple that rounding error could have decided it.
+static double ExpressionEvaluate(const unsigned char *expression, int length, const float px[3], int single, double *magnitude, int *sensitive) {
+    double value = px[expression[0] & 0xF];
+
+    if (value > *magnitude) *magnitude = value;
+    for (int x = 2; x < length; x += 2) {
+        unsigned char operand = expression[x - 1];
+        double b = (operand & 0xF0) == 0x20 ? expressionConstantLookup[operand & 0xF] : px[operand & 0xF];
+        if (fabs(b) > *magnitude) *magnitude = fabs(b);
+        switch (expression[x]) {
+            case 0: value += b; break;
+            case 1: value -= b; break;
+            case 2: value *= b; break;
+            case 3: value /= b; break;
+            case 4: value = pow(fabs(value), fabs(b)); break;
+            case 5: value = log(fabs(value)); break;
+            case 6:
+                if (fabs(value / b - round(value / b)) <= ENUM_CHECK_FLOOR_TOLERANCE * fmax(1.0, fabs(value / b))) *sensitive = TRUE;
+                value = value - b * floor(value / b);
+                break;
+            case 7: value = sin(value); break;
+        }
+        if (single) value = (float)value;
+        if (isfinite(value) && fabs(value) > *magnitude) *magnitude = fabs(value);
+    }
+    return value;
+}
+
+//A packed expression and the rounded, normalized output that identifies its equivalence class, for checking the enumeration
+typedef struct {
+    unsigned char key[ENUM_CHECK_SAMPLES];
+    uint64_t packed;
+} EnumCheckEntry;
+
+static int compareEnumCheckEntries(const void *a, const void *b) {
+    return memcmp(((const EnumCheckEntry*)a)->key, ((const EnumCheckEntry*)b)->key, ENUM_CHECK_SAMPLES);
+}
+
+//Evaluate an expression at every sample and normalize its output to [0,ENUM_CHECK_LEVELS] as the renderer would, leaving infinity and NaN alone. Returns the range before normalizing (0 if there were no finite outputs), with the largest value along the way in *magnitude and whether any sample was decided by rounding error in *sensitive.
+static double EnumCheckNormalize(const unsigned char *expression, int length, const float samples[][3], int single, double steps[ENUM_CHECK_SAMPLES], double *magnitude, int *sensitive) {
+    double min = INFINITY, max = -INFINITY;
+
+    *magnitude = 0.0;
+    *sensitive = FALSE;
+    for (int x = 0; x < ENUM_CHECK_SAMPLES; x++) {
+        steps[x] = ExpressionEvaluate(expression, length, samples[x], single, magnitude, sensitive);
+        if (!isfinite(steps[x])) continue;
+        if (steps[x] < min) min = steps[x];
+        if (steps[x] > max) max = steps[x];
+    }
+    if (min > max) return 0.0;
+    for (int x = 0; x < ENUM_CHECK_SAMPLES; x++) {
+        if (isfinite(steps[x]) && max > min) steps[x] = (steps[x] - min) / (max - min) * ENUM_CHECK_LEVELS;
+    }
+    return max - min;
+}
+
+//Work out the key for a packed expression's class from its output in double precision. Fills in the rounded key, sets borderline to the direction (1 or -1) a sample would have rounded if it had come out slightly differently or to 0 if it's nowhere near, and returns how many were near.
+//Returns -1 if the output is flat (which screening throws out, so its class doesn't matter), or -2 if the expression depends on rounding error (like r*7%r, or when single precision doesn't agree with double) and there's no telling what class it's in.
+static int EnumCheckKey(uint64_t packed, const float samples[][3], unsigned char key[ENUM_CHECK_SAMPLES], int borderline[ENUM_CHECK_SAMPLES]) {
+    unsigned char expression[MAX_EXPRESSION_LENGTH];
+    int length = UnpackExpression(packed, expression), count = 0;
+    double steps[ENUM_CHECK_SAMPLES], singleSteps[ENUM_CHECK_SAMPLES], magnitude, singleMagnitude;
+    int sensitive, singleSensitive;
+
+    //Flat relative to the values along the way, so things like r+g-g-r that only leave rounding error count, but scaling at the end doesn't change whether it's flat
+    double range = EnumCheckNormalize(expression, length, samples, FALSE, steps, &magnitude, &sensitive);
+    if (range <= ENUM_CHECK_FLAT_TOLERANCE * magnitude) return -1;
+    if (sensitive || EnumCheckNormalize(expression, length, samples, TRUE, singleSteps, &singleMagnitude, &singleSensitive) <= 0.0) return -2;
+
+    for (int x = 0; x < ENUM_CHECK_SAMPLES; x++) {
+        borderline[x] = 0;
+        if (isfinite(steps[x]) != isfinite(singleSteps[x])) return -2;
+        if (!isfinite(steps[x])) {
+            key[x] = ENUM_CHECK_LEVELS + 1;
+            continue;
+        }
+        if (fabs(steps[x] - singleSteps[x]) > ENUM_CHECK_UNSTABLE) return -2;
+        key[x] = (unsigned char)(steps[x] + 0.5);
+        if (fabs(steps[x] - floor(steps[x]) - 0.5) < ENUM_CHECK_MARGIN) {
+            borderline[x] = steps[x] - floor(steps[x]) < 0.5 ? 1 : -1;
+            count++;
+        }
+    }
+    return count;
+}
+
+//Whether some kept expression has the same key, trying the borderline samples from sample on rounded both ways
+static int EnumCheckCovered(const EnumCheckEntry *kept, size_t count, EnumCheckEntry *probe, const int borderline[ENUM_CHECK_SAMPLES], int sample) {
+    for (; sample < ENUM_CHECK_SAMPLES && !borderline[sample]; sample++);
+    if (sample == ENUM_CHECK_SAMPLES) return bsearch(probe, kept, count, sizeof *kept, compareEnumCheckEntries) != NULL;
+    if (EnumCheckCovered(kept, count, probe, borderline, sample + 1)) return TRUE;
+
+    probe->key[sample] += borderline[sample];
+    int covered = EnumCheckCovered(kept, count, probe, borderline, sample + 1);
+    probe->key[sample] -= borderline[sample];
+    return covered;
+}
+
+//Walk every ccOcO... expression with up to maxOperators operators, counting the ones whose class no kept expression covers and printing the first few, as well as the ones that are too sensitive to rounding to tell
+static void EnumCheckWalk(const EnumCheckEntry *kept, size_t count, const float samples[][3], uint64_t packed, int operators, int maxOperators, uint64_t *checked, uint64_t *missing, uint64_t *unstable) {
+    for (int pair = 0; pair < 8 << 5; pair++) {
+        EnumCheckEntry probe;
+        int borderline[ENUM_CHECK_SAMPLES];
+        unsigned char expression[MAX_EXPRESSION_LENGTH];
+
+        if ((pair & 0x1F) >= ENUM_OPERANDS) continue;
+        uint64_t next = packed | ((uint64_t)pair << (2 + 8 * operators));
+        probe.packed = next | ((uint64_t)(operators + 1) << PACKED_COUNT_SHIFT);
+
+        int borderlineCount = EnumCheckKey(probe.packed, samples, probe.key, borderline);
+        if (borderlineCount == -2) (*unstable)++;
+        if (borderlineCount >= 0) {
+            (*checked)++;
+            //With too many combinations to try, just round everything to the nearest step
+            if (!EnumCheckCovered(kept, count, &probe, borderline, borderlineCount > ENUM_CHECK_MAX_BORDERLINE ? ENUM_CHECK_SAMPLES : 0) && (*missing)++ < ENUM_CHECK_REPORT) {
+                printf("Missing: ");
+                PrintExpression(stdout, expression, UnpackExpression(probe.packed, expression));
+                printf("\n");
+            }
+        }
+        if (operators + 1 < maxOperators) EnumCheckWalk(kept, count, samples, next, operators + 1, maxOperators, checked, missing, unstable);
+    }
+}
+
+//Check that pruning leaves every class of equivalent expressions with up to maxOperators operators at least one representative: enumerate them, then evaluate every unpruned expression at a set of sample pixels and look for a kept one with the same normalized output. The bare channels count as kept, though they aren't written out. Returns 0 if nothing is missing.
+static int RunEnumerationCheck(int maxOperators) {
+    Enumeration enumeration;
+    EnumerationWorker worker;
+    float samples[ENUM_CHECK_SAMPLES][3];
+    EnumCheckEntry *kept = NULL;
+    size_t count = 0, capacity = 0;
+    uint64_t packed, checked = 0, missing = 0, unstable = 0;
+    int borderline[ENUM_CHECK_SAMPLES];
+
+    if (maxOperators < 1 || maxOperators > ENUM_MAX_OPERATORS) {
+        fprintf(stderr, "Can only enumerate expressions with 1 to %d operators.\r\n", ENUM_MAX_OPERATORS);
+        return 1;
+    }
+
+    //Inputs are texture values; stay away from 0, which only makes more of them infinite
+    srand(1);
+    for (int x = 0; x < ENUM_CHECK_SAMPLES; x++) {
+        for (int y = 0; y < 3; y++) samples[x][y] = 0.05f + 0.9f * random();
+    }
+
+    //Enumerate on this thread, into a temporary file
+    enumeration.maxOperators = maxOperators;
+    enumeration.outputPrefix = NULL;
+    SDL_AtomicSet(&enumeration.nextShard, 0);
+    memset(&worker, 0, sizeof worker);
+    worker.enumeration = &enumeration;
+    worker.file = tmpfile();
+    worker.arena = (uint64_t*)malloc(ENUM_ARENA_SIZE * sizeof (uint64_t));
+    if (!worker.file || !worker.arena) {
+        fprintf(stderr, "Could not set up the enumeration.\r\n");
+        goto catch;
+    }
+    EnumWorker(&worker);
+    if (worker.failed) {
+        fprintf(stderr, "Could not write the enumeration.\r\n");
+        goto catch;
+    }
+
+    //Key every kept expression, plus the bare channels (packed with no operators)
+    rewind(worker.file);
+    for (int channel = 0; channel < 3 || fread(&packed, sizeof packed, 1, worker.file) == 1; channel++) {
+        if (channel < 3) packed = (uint64_t)channel;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            EnumCheckEntry *grown = (EnumCheckEntry*)realloc(kept, capacity * sizeof *kept);
+            if (!grown) {
+                fprintf(stderr, "Out of memory.\r\n");
+                goto catch;
+            }
+            kept = grown;
+        }
+        kept[count].packed = packed;
+        if (EnumCheckKey(packed, samples, kept[count].key, borderline) >= 0) count++;
+    }
+    qsort(kept, count, sizeof *kept, compareEnumCheckEntries);
+
+    //Then look up every expression, pruned or not
+    for (int channel = 0; channel < 3; channel++) EnumCheckWalk(kept, count, samples, (uint64_t)channel, 0, maxOperators, &checked, &missing, &unstable);
+    printf("Checked %llu expressions up to %d operators against %llu kept: %llu classes missing, %llu too sensitive to rounding to check\n",
+        (unsigned long long)checked, maxOperators, (unsigned long long)count, (unsigned long long)missing, (unsigned long long)unstable);
+
+catch:
+    if (worker.file) fclose(worker.file);
+    free(worker.arena);
+    free(kept);
+    return !checked || missing != 0;
+}
+
+
+/*****************************************************************************
+ *                               Farm Functions                              *
+ *****************************************************************************/
+
+static inline FarmSlot *FarmSlotAt(Farm *farm, int worker, unsigned int number) {
+    return (FarmSlot*)(farm->memory + ((size_t)worker * FARM_SLOTS + number % FARM_SLOTS) * farm->slotSize);
+}
+
+static inline unsigned char *FarmSlotPixels(FarmSlot *slot) {
+    return (unsigned char*)slot + sizeof (FarmSlot);
+}
+
+//Generate the image for a seed the same way a tile is: the first expression is the one "seed:N" would give, and screening may throw out a few more before one is kept
+static void FarmRender(APP *app, unsigned int seed, FarmSlot *slot) {
+    GeneratedImage *image = &app->images[RESERVED_TEXTURES];
+    int size = app->inputImageSize;
+
+    srand(seed);
+    image->rejections = 0;
+    do {
+        ChooseExpression(app, RESERVED_TEXTURES);
+        GenerateImage(app, RESERVED_TEXTURES);
+        while (image->state == TILE_COMPILING) FinishCompileJobs(app, TRUE, 0);
+    } while (!image->ready);
+
+    //Straight into the shared memory, so nothing has to be copied to hand it over
+    glBindFramebuffer(GL_FRAMEBUFFER, app->rttFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, image->tex, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, size, size, GL_RGB, GL_UNSIGNED_BYTE, FarmSlotPixels(slot));
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    slot->seed = seed;
+    slot->rejections = image->rejections;
+    memcpy(slot->expression, image->eR, image->lengthR);
+    slot->expressionLength = image->lengthR;
+    memcpy(slot->normalizeMult, image->normalizeMult, sizeof slot->normalizeMult);
+    memcpy(slot->normalizeAdd, image->normalizeAdd, sizeof slot->normalizeAdd);
+    memcpy(slot->embedding, image->embedding, EMBEDDING_SIZE);
+
+    free(image->eR);
+    image->eR = NULL;
+}
+
+#ifndef _WIN32
+//Body of a forked worker process: set up a headless context of its own and fill its ring with its range of seeds, in order. Returns the process's exit status.
+static int FarmWorker(Farm *farm, int number) {
+    APP app;
+    unsigned int first = farm->firstSeed + (unsigned int)((uint64_t)farm->count * number / farm->workers);
+    unsigned int last = farm->firstSeed + (unsigned int)((uint64_t)farm->count * (number + 1) / farm->workers);
+    int failed = 1;
+
+    memset(&app, 0, sizeof (APP));
+    app.headless = TRUE;
+    app.farmWorker = TRUE;
+    setenv("LP_NUM_THREADS", "1", 0); //Keep llvmpipe to one core per worker, unless told otherwise, so the workers don't contend
+
+    if (InitSDL(&app) || InitGL(&app) || InitCompileQueue(&app)) goto catch;
+    if (app.inputImageSize != farm->size) {
+        fprintf(stderr, "Worker %d loaded a %dx%d input instead of %dx%d.\r\n", number, app.inputImageSize, app.inputImageSize, farm->size, farm->size);
+        goto catch;
+    }
+
+    for (unsigned int seed = first; seed != last; seed++) {
+        FarmSlot *slot = FarmSlotAt(farm, number, seed - first);
+        while (SDL_AtomicGet(&slot->state) != SLOT_FREE) SDL_Delay(FARM_POLL_MS); //The coordinator hasn't gotten to it yet
+        FarmRender(&app, seed, slot);
+        SDL_AtomicSet(&slot->state, SLOT_READY);
+    }
+    failed = 0;
+
+catch:
+    UninitCompileQueue(&app);
+    UninitGL(&app);
+    UninitSDL(&app);
+    return failed;
+}
+#endif
+
+//Generate the images for a range of seeds on several worker processes at once, and write each one out (with its sidecar, as if it were exported) and add it to the similarity index as it's finished
+static int RunFarm(int workers, unsigned int firstSeed, unsigned int count) {
+#ifdef _WIN32
+    fprintf(stderr, "The generation farm needs fork(), so it isn't available on Windows.\r\n");
+    return 1;
+#else
+    Farm farm;
+    FilterIndex index;
+    SDL_Surface *input;
+    pid_t pids[FARM_MAX_WORKERS];
+    unsigned int next[FARM_MAX_WORKERS]; //Next slot number to read from each worker's ring
+    unsigned long int written = 0, replaced = 0; //Images saved to new files, and over existing ones
+    int failed = 0, status;
+    char name[64];
+
+    if (workers < 1) workers = SDL_GetCPUCount();
+    if (workers > FARM_MAX_WORKERS) workers = FARM_MAX_WORKERS;
+    if (!(input = SDL_LoadBMP(FARM_INPUT))) {
+        fprintf(stderr, "Could not load %s.\r\n", FARM_INPUT);
+        return 1;
+    }
+    farm.size = input->w;
+    uint32_t inputHash = HashSurface(input);
+    SDL_FreeSurface(input);
+
+    //Slots are cache line aligned, so a worker filling one never shares a line with one the coordinator is reading
+    farm.slotSize = (sizeof (FarmSlot) + (size_t)farm.size * farm.size * 3 + 63) & ~(size_t)63;
+    farm.workers = workers;
+    farm.firstSeed = firstSeed;
+    farm.count = count;
+    //The object is unlinked right away; the mapping lives on in every process that inherits it. It starts out zeroed, so every slot is SLOT_FREE.
+    snprintf(name, sizeof name, "/filtrandmill-farm-%d", (int)getpid());
+    int shm = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (shm >= 0) shm_unlink(name);
+    if (shm < 0 || ftruncate(shm, farm.slotSize * FARM_SLOTS * workers) ||
+        (farm.memory = (unsigned char*)mmap(NULL, farm.slotSize * FARM_SLOTS * workers, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0)) == MAP_FAILED) {
+        if (shm >= 0) close(shm);
+        fprintf(stderr, "Could not map %zu bytes of shared memory.\r\n", farm.slotSize * FARM_SLOTS * workers);
+        return 1;
+    }
+    close(shm);
+
+    //Fork before anything touches SDL's video subsystem or OpenGL, since neither survives it
+    uint64_t start = SDL_GetPerformanceCounter();
+    fflush(NULL);
+    for (int x = 0; x < workers; x++) {
+        next[x] = 0;
+        if ((pids[x] = fork()) == 0) _exit(FarmWorker(&farm, x));
+        if (pids[x] < 0) {
+            fprintf(stderr, "Could not start worker %d.\r\n", x);
+            failed = 1;
+        }
+    }
+    InitIndex(&index, farm.size, inputHash);
+    InitCrcTable(); //WritePNG needs it, and there's no export queue here to set it up
+
+    //Take finished images from each ring in turn until every worker has exited and its ring is empty
+    for (;;) {
+        int consumed = 0, running = 0;
+        for (int x = 0; x < workers; x++) {
+            FarmSlot *slot = FarmSlotAt(&farm, x, next[x]);
+            if (SDL_AtomicGet(&slot->state) == SLOT_READY) {
+                ExportJob job;
+                memset(&job, 0, sizeof job);
+                job.pixels = FarmSlotPixels(slot);
+                job.size = farm.size;
+                memcpy(job.expression, slot->expression, slot->expressionLength);
+                job.expressionLength = slot->expressionLength;
+                memcpy(job.normalizeMult, slot->normalizeMult, sizeof job.normalizeMult);
+                memcpy(job.normalizeAdd, slot->normalizeAdd, sizeof job.normalizeAdd);
+
+                //Named after the seed, since many seeds give the same short expression. Files left over from an earlier run are replaced, but not counted as new.
+                snprintf(name, sizeof name, "seed-%u.png", slot->seed);
+                FILE *file = fopen(name, "rb");
+                int existing = file != NULL;
+                if (file) fclose(file);
+                snprintf(job.name, sizeof job.name, "seed-%u", slot->seed);
+                if (WriteExport(&job)) failed = 1;
+                else if (existing) replaced++;
+                else written++;
+                IndexAdd(&index, slot->embedding, slot->expression, slot->expressionLength, TRUE);
+
+                SDL_AtomicSet(&slot->state, SLOT_FREE);
+                next[x]++;
+                consumed++;
+                running++;
+            } else if (pids[x] > 0) {
+                //Look at its ring once more after it exits, in case it finished one just before
+                running++;
+                if (waitpid(pids[x], &status, WNOHANG) == pids[x]) {
+                    pids[x] = 0;
+                    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+                        fprintf(stderr, "Worker %d failed.\r\n", x);
+                        failed = 1;
+                    }
+                }
+            }
+        }
+        if (!running) break;
+        if (!consumed) SDL_Delay(FARM_POLL_MS);
+    }
+    float seconds = (float)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    UninitIndex(&index);
+    munmap(farm.memory, farm.slotSize * FARM_SLOTS * workers);
+    printf("Generated %lu of %u images in %.2f s on %d workers (%.1f images/s); %lu new files, %lu replaced\n",
+        written + replaced, count, seconds, workers, (written + replaced) / seconds, written, replaced);
+    return failed || written + replaced != count;
+#endif
+}
+
+
+
+/*****************************************************************************
+ *                              Session Functions                            *
+ *****************************************************************************/
+
+//Read the next event of a session being replayed
+static void SessionReadEvent(Session *session) {
+    session->haveNext = fscanf(session->file, "%lf %c %d %d %d", &session->nextTime, &session->nextType, &session->nextArgs[0], &session->nextArgs[1], &session->nextArgs[2]) == 5;
+}
+
+//Open a session file to record to or replay from. When recording, the RNG seed is picked here. Returns 0 on success.
+static int OpenSession(Session *session, const char *filename, int replaying) {
+    session->replaying = replaying;
+    if (!(session->file = fopen(filename, replaying ? "r" : "w"))) {
+        fprintf(stderr, "Could not open %s.\r\n", filename);
+        return 1;
+    }
+
+    if (!replaying) {
+        session->seed = (unsigned int)SDL_GetPerformanceCounter();
+        fprintf(session->file, SESSION_HEADER " %u\n", session->seed);
+    } else if (fscanf(session->file, SESSION_HEADER " %u", &session->seed) != 1) {
+        fprintf(stderr, "%s isn't a session file.\r\n", filename);
+        fclose(session->file);
+        session->file = NULL;
+        return 1;
+    } else SessionReadEvent(session);
+    return 0;
+}
+
+//Close the session file and free the measurements
+static void CloseSession(Session *session) {
+    if (session->file) fclose(session->file);
+    free(session->frameTimes);
+    memset(session, 0, sizeof *session);
+}
+
+//Write an event to the session file, if one is being recorded
+static void SessionRecord(Session *session, char type, int a, int b, int c) {
+    if (!session->file || session->replaying) return;
+    fprintf(session->file, "%.3f %c %d %d %d\n", (SDL_GetPerformanceCounter() - session->start) * 1000.0 / SDL_GetPerformanceFrequency(), type, a, b, c);
+}
+
+//Estimate the texture memory in use, assuming drivers store RGB8 textures with 4 bytes per pixel and RGB32F with 16
+static size_t TextureMemory(APP *app) {
+    size_t image = (size_t)app->inputImageSize * app->inputImageSize * 4;
+    size_t bytes = image //Input
+        + SAMPLE_WIDTH * SCREEN_SAMPLE_SIZE * 16 //Sample
+        + (size_t)app->width * app->height * 4 //Composite
+        + LUT_SIZE * LUT_SIZE * 8; //Lookup table and its domain
+
+    for (int x = RESERVED_TEXTURES; x < app->usedTextures; x++) {
+        if (app->images[x].ready) bytes += image;
+    }
+    for (int x = 0; x < PREFIX_CACHE_SIZE; x++) {
+        if (app->prefixCache.entries[x].tex) bytes += image; //R32F
+    }
+    for (int x = 0; x < INSPECTOR_TILES; x++) {
+        if (app->inspector.tiles[x].tex) bytes += INSPECTOR_TILE_SIZE * INSPECTOR_TILE_SIZE * 4;
+    }
+    return bytes;
+}
+
+//Log how long a replayed frame took and whether it generated any images
+static void SessionFrame(APP *app, double ms, int generated) {
+    Session *session = &app->session;
+    size_t memory = TextureMemory(app);
+
+    if (session->frames == session->capacity) {
+        int capacity = session->capacity ? session->capacity * 2 : 4096;
+        double *frameTimes = (double*)realloc(session->frameTimes, capacity * sizeof *frameTimes);
+        if (!frameTimes) return;
+        session->frameTimes = frameTimes;
+        session->capacity = capacity;
+    }
+    session->frameTimes[session->frames++] = ms;
+    if (generated && ms > 1000.0 / FRAME_RATE) {
+        session->stalls++;
+        session->stallTime += ms - 1000.0 / FRAME_RATE;
+    }
+    if (memory > session->peakMemory) session->peakMemory = memory;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+//Print the results of a replay
+static void SessionReport(Session *session, FILE *file) {
+    double *times = session->frameTimes;
+    int frames = session->frames;
+
+    if (!frames) return;
+    qsort(times, frames, sizeof *times, compareDoubles);
+    fprintf(file, "Replayed %d frames\r\n", frames);
+    fprintf(file, "Frame time (ms): p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\r\n",
+        times[frames / 2], times[(int)(frames * 0.9)], times[(int)(frames * 0.99)], times[frames - 1]);
+    fprintf(file, "Generation stalls: %d frames over the %.2f ms budget, by %.1f ms in total\r\n", session->stalls, 1000.0 / FRAME_RATE, session->stallTime);
+    fprintf(file, "Peak texture memory: %.1f MB\r\n", session->peakMemory / 1048576.0);
 }
 
 
@@ -876,22 +4544,78 @@ static void Render(APP *app) {
  *                             Program Functions                             *
  *****************************************************************************/
 
+//"More like this": queue the filters most similar in appearance to the given image to be generated next, after a few extensions of it that can be drawn from its cached raw output
+static void onLike(APP *app, int textureIdx) {
+    GeneratedImage *image = &app->images[textureIdx];
+    int results[SIMILAR_RESULTS];
+    uint64_t start = SDL_GetPerformanceCounter();
+    int found = IndexSearch(&app->filterIndex, image->embedding, image->eR, image->lengthR, results);
+    float ms = (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+
+    fprintf(stderr, "Filters similar to ");
+    PrintExpression(stderr, image->eR, image->lengthR);
+    fprintf(stderr, " (searched %d in %.2f ms):\r\n", app->filterIndex.count, ms);
+
+    //Queue them so the nearest one comes off the end first
+    app->suggestionCount = 0;
+    for (int x = found - 1; x >= 0; x--) {
+        FilterIndex *index = &app->filterIndex;
+        app->suggestionLengths[app->suggestionCount] = index->lengths[results[x]];
+        memcpy(app->suggestions[app->suggestionCount++], index->expressions + (size_t)results[x] * MAX_EXPRESSION_LENGTH, index->lengths[results[x]]);
+    }
+    for (int x = 0; x < LIKE_CHILDREN; x++) {
+        app->suggestionLengths[app->suggestionCount] = ExtendExpression(image->eR, image->lengthR, app->suggestions[app->suggestionCount]);
+        app->suggestionCount++;
+    }
+    for (int x = 0; x < found; x++) {
+        fprintf(stderr, "    ");
+        PrintExpression(stderr, app->filterIndex.expressions + (size_t)results[x] * MAX_EXPRESSION_LENGTH, app->filterIndex.lengths[results[x]]);
+        fprintf(stderr, " (distance %u)\r\n", EmbeddingDistance(image->embedding, app->filterIndex.embeddings + (size_t)results[x] * EMBEDDING_SIZE));
+    }
+}
+
 //Event handler for mouse down
 static void onMouseDown(APP *app, int button, int x, int y) {
 	app->buttonDown = button;
 	app->oldCursorX = x;
 	app->oldCursorY = y;
+	app->clickX = x;
+	app->clickY = y;
 }
 
 //Event handler for mouse up
 static void onMouseUp(APP *app, int button, int x, int y) {
 	app->buttonDown = 0;
+	if (abs(x - app->clickX) > CLICK_SLOP || abs(y - app->clickY) > CLICK_SLOP) return; //Dragged, not clicked
+
+	//Left-clicking an image opens it in the inspector, and left-clicking again closes it. Right-clicking an image asks for more like it, and middle-clicking saves it.
+	int tile = app->inspector.textureIdx >= 0 ? app->inspector.textureIdx : tileAt(app, x, y);
+	if (tile < 0 || !app->images[tile].ready) return;
+	if (button == SDL_BUTTON_LEFT) {
+	    if (app->inspector.textureIdx >= 0) CloseInspector(app);
+	    else OpenInspector(app, tile);
+	}
+	else if (button == SDL_BUTTON_RIGHT) onLike(app, tile);
+	else if (button == SDL_BUTTON_MIDDLE) ExportImage(app, tile);
 }
 
 //Event handler for mouse move
 static void onMouseMove(APP *app, int x, int y) {
-	if (app->buttonDown == SDL_BUTTON_LEFT) {
-	} else if (app->buttonDown == SDL_BUTTON_RIGHT) {
+	//In the inspector, dragging with the left button pans, and dragging up or down with the right one zooms in or out around where it went down
+	if (app->inspector.textureIdx >= 0) {
+	    if (app->buttonDown == SDL_BUTTON_LEFT) InspectorPan(app, x - app->oldCursorX, y - app->oldCursorY);
+	    else if (app->buttonDown == SDL_BUTTON_RIGHT) InspectorZoom(app, pow(INSPECTOR_DRAG_ZOOM, app->oldCursorY - y), app->clickX, app->clickY);
+	    app->oldCursorX = x;
+	    app->oldCursorY = y;
+	    return;
+	}
+
+	//Only the previously and newly hovered images need to be redrawn
+	int tile = tileAt(app, x, y);
+	if (tile != app->hoverTile) {
+	    DamageTile(app, app->hoverTile);
+	    DamageTile(app, tile);
+	    app->hoverTile = tile;
 	}
 	app->oldCursorX = x;
 	app->oldCursorY = y;
@@ -917,26 +4641,49 @@ static void onResize(APP *app, int width, int height) {
 
     glUniformMatrix4fv(app->attrib_projection, 1, GL_FALSE, matrix);
 
+    //Reallocate the composite texture to match the window; its old contents are lost, so everything needs to be redrawn
+    glBindTexture(GL_TEXTURE_2D, app->textures[2]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, app->compositeFramebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, app->textures[2], 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "Composite framebuffer setup failed; status = %d\r\n", glCheckFramebufferStatus(GL_FRAMEBUFFER));
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
     //Configure application settings
     app->width  = width;
     app->height = height;
+    if (app->inspector.textureIdx >= 0) InspectorPan(app, 0, 0); //Keep the inspected image in view
+    DamageAll(app);
 }
 
 static void onMouseWheel(APP *app, int delta) {
+    //The wheel zooms the inspector, around the cursor
+    if (app->inspector.textureIdx >= 0) {
+        InspectorZoom(app, pow(INSPECTOR_WHEEL_ZOOM, delta), app->oldCursorX, app->oldCursorY);
+        return;
+    }
+
     //Scrolling has exponential momentum, so scrolling more when you're already scrolling will make it speed up!
     app->scrollVelocity = app->scrollVelocity * 1.1f - delta * 5.0f;
 }
 
-//Process window events
-static int DoEvents(APP *app) {
+//Process window events. If timeout is nonzero, sleep for up to that many milliseconds waiting for the first one.
+static int DoEvents(APP *app, int timeout) {
     SDL_Event evt;
     int       quit = 0;
+    int       pending = timeout ? SDL_WaitEventTimeout(&evt, timeout) : SDL_PollEvent(&evt);
 
     //Process all available events
-    while (SDL_PollEvent(&evt)) switch (evt.type) {
+    for (; pending; pending = SDL_PollEvent(&evt)) switch (evt.type) {
 
         //Close
-        case SDL_QUIT: quit = 1; break;
+        case SDL_QUIT:
+            SessionRecord(&app->session, 'Q', 0, 0, 0);
+            quit = 1;
+            break;
 
         //Key down
         case SDL_KEYDOWN:
@@ -946,33 +4693,42 @@ static int DoEvents(APP *app) {
 
         //Mouse down
         case SDL_MOUSEBUTTONDOWN:
+            SessionRecord(&app->session, 'D', evt.button.button, evt.button.x, evt.button.y);
             onMouseDown(app, evt.button.button, evt.button.x, evt.button.y);
             break;
 
         //Mouse up
         case SDL_MOUSEBUTTONUP:
+            SessionRecord(&app->session, 'U', evt.button.button, evt.button.x, evt.button.y);
             onMouseUp(app, evt.button.button, evt.button.x, evt.button.y);
             break;
 
         //Mouse motion
         case SDL_MOUSEMOTION:
+            SessionRecord(&app->session, 'M', evt.motion.x, evt.motion.y, 0);
             onMouseMove(app, evt.motion.x, evt.motion.y);
             break;
 
         //Mouse scroll
         case SDL_MOUSEWHEEL:
-            if (evt.wheel.direction == SDL_MOUSEWHEEL_FLIPPED) onMouseWheel(app, -evt.wheel.y);
-            else onMouseWheel(app, evt.wheel.y);
+            if (evt.wheel.direction == SDL_MOUSEWHEEL_FLIPPED) evt.wheel.y = -evt.wheel.y;
+            SessionRecord(&app->session, 'W', evt.wheel.y, 0, 0);
+            onMouseWheel(app, evt.wheel.y);
             break;
 
         case SDL_WINDOWEVENT: switch (evt.window.event) {
 
         //Resize
         case SDL_WINDOWEVENT_RESIZED:
+            SessionRecord(&app->session, 'R', evt.window.data1, evt.window.data2, 0);
             onResize(app, evt.window.data1, evt.window.data2);
             break;
         case SDL_WINDOWEVENT_EXPOSED:
-            app->updated = TRUE; //Window needs to be redrawn
+            DamageAll(app); //Window needs to be redrawn
+            break;
+        case SDL_WINDOWEVENT_LEAVE:
+            DamageTile(app, app->hoverTile); //Nothing is hovered anymore
+            app->hoverTile = -1;
             break;
 
         } break;
@@ -988,62 +4744,180 @@ static void MainLoop(APP *app) {
     uint64_t taccum  = 0;
     uint64_t tfreq   = SDL_GetPerformanceFrequency();
     uint64_t tprev   = SDL_GetPerformanceCounter();
-    uint64_t ttarget = tfreq / 120;
+    uint64_t ttarget = tfreq / FRAME_RATE;
     uint64_t tthis;
 
-    //Initialize RNG
-    srand((unsigned int) tprev);
+    //Initialize RNG, from the session file's seed if one is being recorded
+    srand(app->session.file ? app->session.seed : (unsigned int) tprev);
+    app->session.start = tprev;
 
     //Configure the initial window size
     onResize(app, app->width, app->height);
 
-    //Generate initial images.
+    //Add the initial tiles; they're generated by ScheduleGeneration like the rest
     while (app->usedTextures < MAX_TEXTURES && app->usedTextures < IMAGES_PER_ROW * (app->scrollMajor + rowsPerScreen(app) + 1) + RESERVED_TEXTURES) GenerateNewImage(app);
 
-    //Loop until a close event is encountered
-    while (!DoEvents(app)) {
+    //Loop until a close event is encountered. Block waiting for events whenever there's nothing to animate or draw.
+    while (!DoEvents(app, isScrolling(app) || app->updated ? 0 : app->compileQueue.inFlight || app->exportQueue.pending || app->pendingTiles || app->inspector.missing ? COMPILE_POLL_MS : IDLE_WAIT_MS)) {
 
         //Calculate timing data
         tthis   = SDL_GetPerformanceCounter();
         taccum += tthis - tprev;
         tprev   = tthis;
 
-        //Process one or more frames
-        if (taccum >= ttarget) {
+        //The fixed-step animation only runs while scrolling; time spent idle must not be caught up on afterward
+        if (!isScrolling(app)) taccum = 0;
 
-            //Animate for each frame elapsed
-            for (; taccum >= ttarget; taccum -= ttarget) {
-                Animate(app);
-            }
+        //Animate for each frame elapsed
+        for (; taccum >= ttarget; taccum -= ttarget) {
+            Animate(app);
+        }
+
+        //Spend what's left of this frame, less what drawing the screen needs, on the inspector's tiles, then on images whose shaders have finished compiling, and then on new ones
+        uint64_t deadline = tthis + (uint64_t)(ttarget * (1.0 - RENDER_RESERVE));
+        app->frameWork = 0;
+        InspectorRenderTiles(app, deadline);
+        if (app->compileQueue.inFlight) FinishCompileJobs(app, FALSE, deadline);
+        ScheduleGeneration(app, deadline);
+
+        //Hand finished readbacks to the export threads
+        if (app->exportQueue.pending) PollExports(app, FALSE);
+
+        //Draw only the most recent frame. With vsync, the buffer swap paces the loop.
+        if (app->updated) Render(app);
+        else if (isScrolling(app)) SDL_Delay(1); //Relinquish CPU control to the OS for a moment while waiting for the next animation step
+    }
+}
+
+//Send the events of a session being replayed that happened by the given time (milliseconds since the start) to their handlers. Returns TRUE if the session ended.
+static int ReplayEvents(APP *app, double now) {
+    Session *session = &app->session;
+    int quit = FALSE;
 
-            //Draw only the most recent frame
-            if (app->updated) Render(app);
-            app->updated = FALSE;
+    for (; session->haveNext && session->nextTime <= now && !quit; SessionReadEvent(session)) {
+        int *args = session->nextArgs;
+        switch (session->nextType) {
+            case 'Q': quit = TRUE; break;
+            case 'D': onMouseDown(app, args[0], args[1], args[2]); break;
+            case 'U': onMouseUp(app, args[0], args[1], args[2]); break;
+            case 'M': onMouseMove(app, args[0], args[1]); break;
+            case 'W': onMouseWheel(app, args[0]); break;
+            case 'R':
+                SDL_SetWindowSize(app->window, args[0], args[1]);
+                onResize(app, args[0], args[1]);
+                break;
+            default: break;
         }
+    }
+    return quit;
+}
+
+//Replay a recorded session with the window hidden, one animation step per frame at FRAME_RATE, then report how long the frames took
+static void ReplayLoop(APP *app) {
+    Session *session = &app->session;
+    uint64_t tfreq   = SDL_GetPerformanceFrequency();
+    uint64_t ttarget = tfreq / FRAME_RATE;
+    int quit = FALSE;
+
+    srand(session->seed);
+    onResize(app, app->width, app->height);
+    while (app->usedTextures < MAX_TEXTURES && app->usedTextures < IMAGES_PER_ROW * (app->scrollMajor + rowsPerScreen(app) + 1) + RESERVED_TEXTURES) GenerateNewImage(app);
 
-        //Relinquish CPU control to the OS for a moment
-        SDL_Delay(1);
+    //Run until the session ends, or until its events run out and everything has settled
+    for (unsigned long int frame = 0; !quit && (session->haveNext || isScrolling(app) || app->pendingTiles || app->compileQueue.inFlight || app->inspector.missing); frame++) {
+        uint64_t tthis = SDL_GetPerformanceCounter();
+        unsigned long int screened = app->screenStats.screened;
+
+        //The hidden window's own events aren't part of the session
+        SDL_PumpEvents();
+        SDL_FlushEvents(SDL_FIRSTEVENT, SDL_LASTEVENT);
+        quit = ReplayEvents(app, frame * 1000.0 / FRAME_RATE);
+
+        //The same work as an iteration of MainLoop, with exactly one animation step
+        Animate(app);
+        uint64_t deadline = tthis + (uint64_t)(ttarget * (1.0 - RENDER_RESERVE));
+        app->frameWork = 0;
+        InspectorRenderTiles(app, deadline);
+        if (app->compileQueue.inFlight) FinishCompileJobs(app, FALSE, deadline);
+        ScheduleGeneration(app, deadline);
+        if (app->exportQueue.pending) PollExports(app, FALSE);
+        if (app->updated) Render(app);
+        glFinish(); //Count the GPU's time too, since nothing waits for the vertical blank
+
+        //Then wait out the rest of the frame, as vsync would
+        uint64_t elapsed = SDL_GetPerformanceCounter() - tthis;
+        SessionFrame(app, elapsed * 1000.0 / tfreq, app->screenStats.screened != screened);
+        if (elapsed < ttarget) SDL_Delay((Uint32)((ttarget - elapsed) * 1000 / tfreq));
     }
+    SessionReport(session, stdout);
 }
 
 //Program entry point
 int main(int argc, char **argv) {
     APP app;
+    int port = SERVER_DEFAULT_PORT;
 
     memset(&app, 0, sizeof (APP));
 
+    //"--client <port> <output.bmp> <request>" sends one request to a running server; "--serve [port]" runs the headless rendering server
+    if (argc >= 2 && !strcmp(argv[1], "--client")) {
+        if (argc < 5) {
+            fprintf(stderr, "Usage: %s --client <port> <output.bmp> \"<RENDER|NORMALIZE> <input image> <hex bytecode|seed:N>\"\r\n", argv[0]);
+            return 1;
+        }
+        return RunClient(atoi(argv[2]), argv[3], argv[4]);
+    }
+
+    //"--enumerate <max operators> <output prefix> [threads]" writes every canonical expression up to that length; "--unpack <file>" prints one of its outputs as hex bytecode
+    if (argc >= 2 && !strcmp(argv[1], "--enumerate")) {
+        if (argc < 4) {
+            fprintf(stderr, "Usage: %s --enumerate <max operators> <output prefix> [threads]\r\n", argv[0]);
+            return 1;
+        }
+        return RunEnumeration(atoi(argv[2]), argv[3], argc >= 5 ? atoi(argv[4]) : 0);
+    }
+    if (argc >= 3 && !strcmp(argv[1], "--unpack")) return RunUnpack(argv[2]);
+    if (argc >= 3 && !strcmp(argv[1], "--enumerate-check")) return RunEnumerationCheck(atoi(argv[2])); //"--enumerate-check <max operators>" checks that pruning loses nothing
+
+    //"--farm <first seed> <count> [workers]" generates and saves the images for a range of seeds on several processes at once
+    if (argc >= 2 && !strcmp(argv[1], "--farm")) {
+        if (argc < 4) {
+            fprintf(stderr, "Usage: %s --farm <first seed> <count> [workers]\r\n", argv[0]);
+            return 1;
+        }
+        return RunFarm(argc >= 5 ? atoi(argv[4]) : 0, (unsigned int)strtoul(argv[2], NULL, 10), (unsigned int)strtoul(argv[3], NULL, 10));
+    }
+    if (argc >= 2 && !strcmp(argv[1], "--serve")) {
+        app.headless = TRUE;
+        if (argc >= 3) port = atoi(argv[2]);
+    }
+
+    //"--record <file>" saves the events of an interactive session; "--replay <file>" plays them back with the window hidden and reports frame times
+    if (argc >= 2 && (!strcmp(argv[1], "--record") || !strcmp(argv[1], "--replay"))) {
+        if (argc < 3) {
+            fprintf(stderr, "Usage: %s %s <session file>\r\n", argv[0], argv[1]);
+            return 1;
+        }
+        if (OpenSession(&app.session, argv[2], !strcmp(argv[1], "--replay"))) return 1;
+    }
+
     //Initialize application components
-    if (InitSDL(&app) || InitGL(&app))
+    if (InitSDL(&app) || InitGL(&app) || InitCompileQueue(&app) || InitExportQueue(&app))
         goto cleanup;
 
     //Main program processing
     InitApp(&app);
-    MainLoop(&app);
+    if (app.headless) ServerLoop(&app, port);
+    else if (app.session.replaying) ReplayLoop(&app);
+    else MainLoop(&app);
 
 //Common cleanup code
 cleanup:
+    UninitExportQueue(&app);
     UninitApp(&app);
+    UninitCompileQueue(&app);
     UninitGL (&app);
     UninitSDL(&app);
+    CloseSession(&app.session);
     return 0;
 }